@@ -9,6 +9,9 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// bit-identical depth to the pre-pass, which runs a different program (GL_EQUAL)
+invariant gl_Position;
+
 void main()
 {
     Normal = vec3(model * vec4(aNormal, 0.0));
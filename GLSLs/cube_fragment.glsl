@@ -1,58 +1,43 @@
 # version 330 core
 
-struct Material {
-    // object color values & strength
-    sampler2D diffuse;
-    sampler2D specular;
-    float shininess;
-};
-
-struct Light {
-    // light color values & strength
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    // vec3 position;
-    vec3 direction;
-};
+#include "lighting.glsl"
 
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
 
-uniform vec3 lightColor;
-uniform vec3 viewPos;
+#ifdef TEXTURED
+// the node's tile in the texture array: layer, then offset (xy) and size (zw) in layer uv
+uniform float textureLayer;
+uniform vec4 textureRect;
 
-uniform Material material;
-uniform Light light;
+vec4 sampleTile (sampler2DArray map, vec2 uv)
+{
+    // repeat inside the tile; gradients of the unwrapped uv keep the mip level across the wrap
+    vec2 tileUV = textureRect.xy + fract(uv) * textureRect.zw;
+    return textureGrad(map, vec3(tileUV, textureLayer), dFdx(uv) * textureRect.zw, dFdy(uv) * textureRect.zw);
+}
+#else
+uniform vec3 objectColor;
+#endif
 
 void main () {
-    // pre-parameters
-    // --------------
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(light.direction - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    // ambient
-    // -------
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-
-    // diffuse
-    // -------
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse  = light.diffuse * (diff * texture(material.diffuse, TexCoords)).rgb;
-
-    // specular
-    // --------
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * (spec * texture(material.specular, TexCoords).rgb);
+#ifdef TEXTURED
+    vec3 albedo = sampleTile(material.diffuse, TexCoords).rgb;
+#ifdef SPECULAR
+    vec3 specularMap = sampleTile(material.specular, TexCoords).rgb;
+#else
+    vec3 specularMap = vec3(0.0);
+#endif
+#else
+    vec3 albedo = objectColor;
+    vec3 specularMap = vec3(1.0);
+#endif
 
     // final result
     // ------------
-    vec3 result = ambient + diffuse + specular;
+    vec3 result = shadePhong(normalize(Normal), FragPos, albedo, specularMap);
     FragColor = vec4(result, 1.0);
-};
\ No newline at end of file
+};
@@ -0,0 +1,36 @@
+#version 330 core
+// light accumulation of the deferred path: every covered pixel of the G-buffer is
+// shaded once with the same lighting.glsl code the forward shaders use
+
+#include "lighting.glsl"
+
+layout (location = 0) out vec4 FragColor;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gSurface;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+void main ()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing drawn here, keep the clear color
+    if (depth == 1.0)
+        discard;
+
+    // world position back from the depth buffer
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 world = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+
+    vec3 albedo = texelFetch(gAlbedo, pixel, 0).rgb;
+    vec4 surface = texelFetch(gSurface, pixel, 0);
+    vec3 norm = decodeNormal(surface.xy);
+
+    vec3 result = surface.w > 0.0 ? shadeSurface(norm, fragPos, albedo, vec3(surface.z), surface.w * 256.0)
+                                  : shadeLambert(norm, fragPos, albedo);
+    FragColor = vec4(result, 1.0);
+    // forward passes after this one test against the scene
+    gl_FragDepth = depth;
+}
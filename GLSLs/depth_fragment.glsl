@@ -0,0 +1,6 @@
+#version 330 core
+// depth pre-pass: nothing but the depth the rasteriser already computed
+
+void main()
+{
+}
@@ -0,0 +1,16 @@
+#version 330 core
+// depth pre-pass of mesh nodes: reads the position-only stream (buildPositionStream)
+// and must land on exactly the depth cube_vertex.glsl and colored_vertex.glsl
+// produce, hence the same expression and the invariant output
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
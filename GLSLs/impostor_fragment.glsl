@@ -0,0 +1,80 @@
+#version 330 core
+
+#include "lighting.glsl"
+
+in vec3 RayDir;
+flat in mat4 ViewToObject;
+flat in mat4 Model;
+flat in mat3 NormalMatrix;
+flat in vec4 Color;
+flat in vec4 TextureRect;
+
+layout (location = 0) out vec4 FragColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+const float PI = 3.14159265359;
+
+// same parameterisation as buildSphereData: u around y starting at +x, v from the north pole
+vec2 sphereUV (vec3 p)
+{
+    float u = atan(p.z, p.x) / (2.0 * PI);
+    float v = acos(clamp(2.0 * p.y, -1.0, 1.0)) / PI;
+    return vec2(u < 0.0 ? u + 1.0 : u, v);
+}
+
+vec3 shadeTextured (vec3 norm, vec3 fragPos, vec2 uv)
+{
+    // pick whichever of [0, 1) or [-0.5, 0.5) is continuous here so the seam keeps its mip level
+    vec2 uvWrapped = vec2(fract(uv.x + 0.5) - 0.5, uv.y);
+    vec2 dx = dFdx(uv), dy = dFdy(uv);
+    if (fwidth(uv.x) > fwidth(uvWrapped.x))
+    {
+        dx = dFdx(uvWrapped);
+        dy = dFdy(uvWrapped);
+    }
+    // repeat inside the node's tile of the texture array
+    vec3 tileUV = vec3(TextureRect.xy + fract(uv) * TextureRect.zw, Color.w - 1.0);
+    dx *= TextureRect.zw;
+    dy *= TextureRect.zw;
+    vec3 albedo = textureGrad(material.diffuse, tileUV, dx, dy).rgb;
+    vec3 specularMap = textureGrad(material.specular, tileUV, dx, dy).rgb;
+    return shadePhong(norm, fragPos, albedo, specularMap);
+}
+
+void main ()
+{
+    // intersect the view ray with the radius 0.5 sphere in object space
+    // ----------------------------------------------------------------
+    vec3 ro = (ViewToObject * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+    vec3 rd = (ViewToObject * vec4(RayDir, 0.0)).xyz;
+
+    float a = dot(rd, rd);
+    float b = dot(ro, rd);
+    float c = dot(ro, ro) - 0.25;
+    float disc = b * b - a * c;
+    if (disc < 0.0)
+        discard;
+    float t = (-b - sqrt(disc)) / a;
+    // camera inside the sphere: use the far intersection
+    if (t < 0.0)
+        t = (-b + sqrt(disc)) / a;
+    if (t < 0.0)
+        discard;
+
+    vec3 p = ro + t * rd;
+    vec3 fragPos = vec3(Model * vec4(p, 1.0));
+    vec3 norm = normalize(NormalMatrix * p);
+
+    vec4 clip = projection * view * vec4(fragPos, 1.0);
+    gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+#ifdef DEPTH_ONLY
+    return;
+#endif
+
+    // final result
+    // ------------
+    vec3 result = Color.w > 0.5 ? shadeTextured(norm, fragPos, sphereUV(p)) : shadeLambert(norm, fragPos, Color.rgb);
+    FragColor = vec4(result, 1.0);
+}
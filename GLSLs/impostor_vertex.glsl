@@ -0,0 +1,49 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;   // quad corner in [-1, 1]
+layout (location = 3) in mat4 aModel;    // per instance, occupies locations 3 - 6
+layout (location = 7) in vec4 aColor;    // per instance, rgb + array layer + 1 in w (0 = untextured)
+layout (location = 8) in vec4 aTextureRect; // per instance tile of the texture array
+
+out vec3 RayDir;
+flat out mat4 ViewToObject;
+flat out mat4 Model;
+flat out mat3 NormalMatrix;
+flat out vec4 Color;
+flat out vec4 TextureRect;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    Model = aModel;
+    NormalMatrix = transpose(inverse(mat3(aModel)));
+    ViewToObject = inverse(view * aModel);
+    Color = aColor;
+    TextureRect = aTextureRect;
+
+    // bounding sphere of the (possibly non-uniformly scaled) unit-diameter sphere
+    float radius = 0.5 * max(length(aModel[0].xyz), max(length(aModel[1].xyz), length(aModel[2].xyz)));
+    vec3 center = (view * aModel[3]).xyz;
+    float dist = length(center);
+
+    if (dist <= radius * 1.001)
+    {
+        // camera inside the sphere: cover the whole screen and let every pixel cast a ray
+        vec4 corner = inverse(projection) * vec4(aCorner, -1.0, 1.0);
+        RayDir = corner.xyz / corner.w;
+        gl_Position = vec4(aCorner, 0.0, 1.0);
+        return;
+    }
+
+    // quad through the center, facing the camera and large enough to hold the silhouette cone
+    vec3 w = center / dist;
+    vec3 helper = abs(w.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 u = normalize(cross(helper, w));
+    vec3 v = cross(w, u);
+    float halfSize = radius * dist / sqrt(dist * dist - radius * radius);
+
+    vec3 corner = center + (aCorner.x * u + aCorner.y * v) * halfSize;
+    RayDir = corner;
+    gl_Position = projection * vec4(corner, 1.0);
+}
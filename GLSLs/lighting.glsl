@@ -0,0 +1,179 @@
+// lights, materials and shading shared by the lit fragment shaders, pulled in with
+// #include "lighting.glsl"; SPECULAR switches the Phong highlight on, DEFERRED turns
+// shadePhong and shadeLambert into G-buffer writes (DeferredRenderer.hpp)
+
+struct Material {
+    // object color values & strength
+    sampler2DArray diffuse;
+    sampler2DArray specular;
+    float shininess;
+};
+
+struct Light {
+    // light color values & strength
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    // vec3 position;
+    vec3 direction;
+};
+
+uniform vec3 viewPos;
+
+// textured nodes: the `light` struct
+uniform Material material;
+uniform Light light;
+
+// flat colored nodes: a plain point light
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+
+// every other light, binned into view space clusters on the CPU (ClusteredLights.hpp)
+uniform samplerBuffer lightData;      // per light: position and radius, color and cos outer, direction and cos inner
+uniform usamplerBuffer clusterGrid;   // per cluster: first index and count in clusterLights
+uniform usamplerBuffer clusterLights; // light indices
+uniform vec3 clusterCount;
+uniform vec4 clusterScale;            // gl_FragCoord to tile (xy), log view depth to slice (zw)
+uniform vec4 clusterDepth;            // view matrix row giving view space z
+
+// the clustered lights reaching fragPos, added on top of the main light
+vec3 shadeLights (vec3 norm, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess)
+{
+    float depth = max(-dot(clusterDepth, vec4(fragPos, 1.0)), 1e-4);
+    vec3 cell = clamp(floor(vec3(gl_FragCoord.xy * clusterScale.xy, log(depth) * clusterScale.z + clusterScale.w)),
+                      vec3(0.0), clusterCount - 1.0);
+    int cluster = int((cell.z * clusterCount.y + cell.y) * clusterCount.x + cell.x);
+    uvec2 range = texelFetch(clusterGrid, cluster).xy;
+#ifdef SPECULAR
+    vec3 viewDir = normalize(viewPos - fragPos);
+#endif
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        int index = int(texelFetch(clusterLights, int(range.x + i)).r) * 3;
+        vec4 positionRadius = texelFetch(lightData, index);
+        vec4 colorOuter = texelFetch(lightData, index + 1);
+        vec4 directionInner = texelFetch(lightData, index + 2);
+
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float distance = length(toLight);
+        vec3 lightDir = toLight / max(distance, 1e-4);
+        // smooth falloff reaching zero at the radius, then the spot cone
+        float falloff = clamp(1.0 - distance * distance / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        falloff *= falloff * smoothstep(colorOuter.w, directionInner.w, dot(-lightDir, directionInner.xyz));
+
+        vec3 lit = max(dot(norm, lightDir), 0.0) * albedo;
+#ifdef SPECULAR
+        lit += pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), shininess) * specularColor;
+#endif
+        result += falloff * colorOuter.rgb * lit;
+    }
+    return result;
+}
+
+// octahedral normal packing for the G-buffer: unit vector <-> [0, 1]^2
+vec2 encodeNormal (vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return folded * 0.5 + 0.5;
+}
+
+vec3 decodeNormal (vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+#ifdef DEFERRED
+// G-buffer pass: FragColor (location 0) receives the albedo these return, the rest
+// of the surface goes here: normal (xy), specular strength, shininess / 256 with
+// 0 marking the Lambert model
+layout (location = 1) out vec4 gSurface;
+
+vec3 shadePhong (vec3 norm, vec3 fragPos, vec3 albedo, vec3 specularColor)
+{
+#ifdef SPECULAR
+    float strength = max(specularColor.r, max(specularColor.g, specularColor.b));
+#else
+    float strength = 0.0;
+#endif
+    gSurface = vec4(encodeNormal(norm), strength, max(material.shininess, 1.0) / 256.0);
+    return albedo;
+}
+
+vec3 shadeLambert (vec3 norm, vec3 fragPos, vec3 color)
+{
+    gSurface = vec4(encodeNormal(norm), 0.0, 0.0);
+    return color;
+}
+#else
+// shadow of the main light: distances in a cube around it (ShadowMaps.hpp), static
+// casters cached there and dynamic ones drawn on top every frame
+uniform samplerCubeShadow shadowMap;
+uniform vec3 shadowPosition;
+uniform float shadowFar; // 0 with shadows off
+
+// 1 lit, 0 shadowed; receivers past shadowFar have no casters to test
+float shadowFactor (vec3 norm, vec3 fragPos)
+{
+    if (shadowFar <= 0.0)
+        return 1.0;
+    // offset along the normal and pulled towards the light against acne
+    vec3 toFrag = fragPos + 0.05 * norm - shadowPosition;
+    float distance = length(toFrag);
+    if (distance >= shadowFar)
+        return 1.0;
+    return texture(shadowMap, vec4(toFrag, (distance - 0.05) / shadowFar));
+}
+
+// Phong of `light` with the clustered lights on top: albedo for ambient and diffuse,
+// specularColor scales the highlight
+vec3 shadeSurface (vec3 norm, vec3 fragPos, vec3 albedo, vec3 specularColor, float shininess)
+{
+    vec3 lightDir = normalize(light.direction - fragPos);
+
+    // ambient
+    // -------
+    vec3 ambient = light.ambient * albedo;
+
+    // diffuse
+    // -------
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * albedo;
+
+    // specular
+    // --------
+#ifdef SPECULAR
+    vec3 reflectDir = reflect(-lightDir, norm);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = light.specular * spec * specularColor;
+#else
+    vec3 specular = vec3(0.0);
+#endif
+
+    return ambient + shadowFactor(norm, fragPos) * (diffuse + specular) + shadeLights(norm, fragPos, albedo, specularColor, shininess);
+}
+
+vec3 shadePhong (vec3 norm, vec3 fragPos, vec3 albedo, vec3 specularColor)
+{
+    return shadeSurface(norm, fragPos, albedo, specularColor, material.shininess);
+}
+
+// ambient and diffuse of the point light, tinted by color
+vec3 shadeLambert (vec3 norm, vec3 fragPos, vec3 color)
+{
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * lightColor;
+    vec3 lightDir = normalize(lightPos - fragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+    return (ambient + shadowFactor(norm, fragPos) * diffuse) * color + shadeLights(norm, fragPos, color, vec3(0.0), 1.0);
+}
+#endif
@@ -0,0 +1,121 @@
+#version 330 core
+// attribute-less cube / uv sphere / capsule, generated from gl_VertexID
+// drop-in replacement for cube_vertex.glsl and colored_vertex.glsl, with the
+// same per face uv layout as buildCubeData
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// bit-identical depth to the pre-pass, which runs a different program (GL_EQUAL)
+invariant gl_Position;
+
+uniform int primitive;   // 0 = cube, 1 = uv sphere, 2 = capsule
+uniform int segments;    // tessellation of sphere and capsule
+
+#ifdef INSTANCED
+// instanced draws read one matrix (four texels) per gl_InstanceID, from
+// instanceBase on, and place "model" inside it
+uniform samplerBuffer instanceModels;
+uniform int instanceBase;
+#endif
+
+const float PI = 3.14159265359;
+
+// two triangles per quad, corners as (u, v) steps
+const vec2 QUAD[6] = vec2[6](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(1.0, 1.0), vec2(0.0, 1.0), vec2(0.0, 0.0)
+);
+
+// cube faces in buildCubeData's order: normal, then the directions u and v grow in
+const vec3 FACE_NORMAL[6] = vec3[6](
+    vec3( 0.0,  0.0, -1.0), vec3( 0.0,  0.0,  1.0), vec3(-1.0,  0.0,  0.0),
+    vec3( 1.0,  0.0,  0.0), vec3( 0.0, -1.0,  0.0), vec3( 0.0,  1.0,  0.0)
+);
+const vec3 FACE_U[6] = vec3[6](
+    vec3( 1.0,  0.0,  0.0), vec3( 1.0,  0.0,  0.0), vec3( 0.0,  1.0,  0.0),
+    vec3( 0.0,  1.0,  0.0), vec3( 1.0,  0.0,  0.0), vec3( 1.0,  0.0,  0.0)
+);
+const vec3 FACE_V[6] = vec3[6](
+    vec3( 0.0,  1.0,  0.0), vec3( 0.0,  1.0,  0.0), vec3( 0.0,  0.0, -1.0),
+    vec3( 0.0,  0.0, -1.0), vec3( 0.0,  0.0, -1.0), vec3( 0.0,  0.0, -1.0)
+);
+
+void cubeVertex (int id, out vec3 position, out vec3 normal, out vec2 uv)
+{
+    int face = id / 6;
+    uv = QUAD[id % 6];
+    normal = FACE_NORMAL[face];
+    position = 0.5 * (normal + (2.0 * uv.x - 1.0) * FACE_U[face] + (2.0 * uv.y - 1.0) * FACE_V[face]);
+}
+
+// point on the radius 0.5 sphere, same parameterisation as buildSphereData
+vec3 spherePoint (float u, float v)
+{
+    return 0.5 * vec3(cos(u * 2.0 * PI) * sin(v * PI), cos(v * PI), sin(u * 2.0 * PI) * sin(v * PI));
+}
+
+void sphereVertex (int id, out vec3 position, out vec3 normal, out vec2 uv)
+{
+    int quad = id / 6;
+    vec2 corner = QUAD[id % 6];
+    uv = vec2(float(quad % segments) + corner.x, float(quad / segments) + corner.y) / float(segments);
+    position = spherePoint(uv.x, uv.y);
+    normal = position;
+}
+
+// radius 0.25 hemispheres joined by a 0.5 high cylinder, fits the unit cube like the others
+void capsuleVertex (int id, out vec3 position, out vec3 normal, out vec2 uv)
+{
+    const float radius = 0.25;
+    const float halfHeight = 0.25;
+    int quad = id / 6;
+    vec2 corner = QUAD[id % 6];
+    float u = (float(quad % segments) + corner.x) / float(segments);
+    int row = quad / segments + int(corner.y);
+
+    // rows up to the equator belong to the top cap, the rest to the bottom cap; the
+    // band between the two equator rows is the cylinder
+    bool top = row <= segments / 2;
+    float v = float(top ? row : row - 1) / float(segments);
+    normal = 2.0 * spherePoint(u, v);
+    position = radius * normal + vec3(0.0, top ? halfHeight : -halfHeight, 0.0);
+    uv = vec2(u, 0.5 - position.y);
+}
+
+#ifdef INSTANCED
+mat4 instanceModel ()
+{
+    int base = (instanceBase + gl_InstanceID) * 4;
+    return mat4(texelFetch(instanceModels, base), texelFetch(instanceModels, base + 1),
+                texelFetch(instanceModels, base + 2), texelFetch(instanceModels, base + 3));
+}
+#endif
+
+void main()
+{
+    vec3 position, normal;
+    vec2 uv;
+    if (primitive == 0)
+        cubeVertex(gl_VertexID, position, normal, uv);
+    else if (primitive == 1)
+        sphereVertex(gl_VertexID, position, normal, uv);
+    else
+        capsuleVertex(gl_VertexID, position, normal, uv);
+
+#ifdef INSTANCED
+    mat4 world = instanceModel() * model;
+#else
+    mat4 world = model;
+#endif
+    Normal = vec3(world * vec4(normal, 0.0));
+    FragPos = vec3(world * vec4(position, 1.0));
+    TexCoords = uv;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+// shadow casters: distance to the light as depth, one cube face at a time (ShadowMaps.hpp)
+
+in vec3 FragPos;
+
+uniform vec3 shadowPosition;
+uniform float shadowFar;
+
+void main ()
+{
+    gl_FragDepth = length(FragPos - shadowPosition) / shadowFar;
+}
@@ -0,0 +1,25 @@
+#version 330 core
+// feedback pass: which virtual page and mip level every fragment would sample,
+// written as (page x, page y, level) / 255; alpha 0 is left where nothing was drawn
+
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+uniform int pages;      // pages per side on level 0
+uniform int levels;
+uniform float lodBias;  // log2 of the feedback buffer's downscale
+
+const float PAGE_SIZE = 128.0;
+
+void main ()
+{
+    vec2 texels = TexCoords * float(pages) * PAGE_SIZE;
+    vec2 dx = dFdx(texels), dy = dFdy(texels);
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - lodBias, 0.0, float(levels - 1));
+
+    int level = int(lod);
+    vec2 uv = vec2(fract(TexCoords.x), clamp(TexCoords.y, 0.0, 1.0));
+    ivec2 page = min(ivec2(uv * float(pages >> level)), ivec2((pages >> level) - 1));
+    FragColor = vec4(vec3(page, level) / 255.0, 1.0);
+}
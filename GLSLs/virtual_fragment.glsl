@@ -0,0 +1,62 @@
+# version 330 core
+
+#include "lighting.glsl"
+
+// page table (one texel per page and mip level: slot x, slot y, level the slot holds)
+// and the physical page cache, see VirtualTexture.hpp
+struct VirtualTexture {
+    sampler2D indirection;
+    sampler2D physical;
+    int pages;      // pages per side on level 0
+    int levels;
+    float slots;    // cache slots per side
+};
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 FragColor;
+
+uniform VirtualTexture virtualTexture;
+
+const float PAGE_SIZE = 128.0;
+const float PAGE_BORDER = 4.0;
+const float TILE_SIZE = PAGE_SIZE + 2.0 * PAGE_BORDER;
+
+// one bilinear tap of the page covering uv on `level`, or of its resident ancestor
+vec4 sampleVirtualLevel (vec2 uv, int level)
+{
+    ivec2 page = clamp(ivec2(uv * float(virtualTexture.pages >> level)), ivec2(0), ivec2((virtualTexture.pages >> level) - 1));
+    vec3 entry = texelFetch(virtualTexture.indirection, page, level).xyz * 255.0;
+
+    // position inside the page the slot actually holds, which may be coarser
+    float residentPages = float(virtualTexture.pages >> int(entry.z + 0.5));
+    vec2 inPage = clamp(uv * residentPages - floor(min(uv * residentPages, residentPages - 1.0)), 0.0, 1.0);
+    vec2 texel = floor(entry.xy + 0.5) * TILE_SIZE + PAGE_BORDER + inPage * PAGE_SIZE;
+    return textureLod(virtualTexture.physical, texel / (virtualTexture.slots * TILE_SIZE), 0.0);
+}
+
+// trilinear filtering done by hand: the cache has no mips, every level is its own page
+vec4 sampleVirtual (vec2 uv)
+{
+    vec2 texels = uv * float(virtualTexture.pages) * PAGE_SIZE;
+    vec2 dx = dFdx(texels), dy = dFdy(texels);
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, float(virtualTexture.levels - 1));
+
+    // longitude repeats, latitude stops at the poles
+    uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));
+    int level = int(lod);
+    vec4 fine = sampleVirtualLevel(uv, level);
+    vec4 coarse = sampleVirtualLevel(uv, min(level + 1, virtualTexture.levels - 1));
+    return mix(fine, coarse, lod - float(level));
+}
+
+void main () {
+    vec3 albedo = sampleVirtual(TexCoords).rgb;
+
+    // final result
+    // ------------
+    vec3 result = shadePhong(normalize(Normal), FragPos, albedo, albedo);
+    FragColor = vec4(result, 1.0);
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "LZ4.hpp"
+#include "MappedFile.hpp"
+
+// every loose file under resources/ packed into one mmapped archive (built by
+// pack_assets from the Makefile). The table of contents is an open addressing
+// hash table over the names, payloads start on ASSET_ARCHIVE_ALIGNMENT, and an
+// entry is either stored (read in place, no copy) or LZ4 compressed.
+// Layout: header, entries, slots, names, payloads
+// ------------------------------------------------------------------------------
+
+const uint32_t ASSET_ARCHIVE_VERSION = 1;
+const uint64_t ASSET_ARCHIVE_ALIGNMENT = 64;
+
+enum AssetCodec {
+    ASSET_STORED = 0,
+    ASSET_LZ4 = 1
+};
+
+struct AssetArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount, slotCount; // slotCount a power of two
+    uint64_t namesOffset, namesSize;
+};
+
+struct AssetArchiveEntry {
+    uint64_t nameHash;
+    uint32_t nameOffset, nameLength; // into the name block
+    uint64_t offset, size;           // payload in the archive
+    uint64_t rawSize;                // size once decompressed
+    uint32_t codec, reserved;
+};
+
+// one asset's bytes: a view into the archive, a decompressed copy or a loose file mapping
+struct AssetData {
+    const unsigned char * data;
+    size_t size;
+    std::vector<unsigned char> storage;
+    MappedFile file;
+
+    AssetData ()
+        : data(NULL), size(0) {}
+};
+
+// a file to pack, named relative to the archive root
+struct AssetSource {
+    std::string name;
+    std::vector<unsigned char> bytes;
+};
+
+class AssetArchive {
+public:
+    AssetArchive ()
+        : m_header(NULL), m_entries(NULL), m_slots(NULL) {}
+
+    // paths handed to read() are the archive names with `root` in front ("../")
+    bool open (const char * path, const std::string & root)
+    {
+        MappedFile mapping(path);
+        if (!mapping.valid() || mapping.size() < sizeof(AssetArchiveHeader))
+            return false;
+        const AssetArchiveHeader * header = (const AssetArchiveHeader *)mapping.data();
+        uint64_t tableEnd = sizeof(AssetArchiveHeader) + (uint64_t)header->entryCount * sizeof(AssetArchiveEntry)
+                          + (uint64_t)header->slotCount * sizeof(uint32_t);
+        if (memcmp(header->magic, "GPAK", 4) != 0 || header->version != ASSET_ARCHIVE_VERSION
+            || header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0
+            || tableEnd > header->namesOffset || header->namesOffset + header->namesSize > mapping.size())
+        {
+            std::cout << "WARNING::ASSET_ARCHIVE::INVALID " << path << std::endl;
+            return false;
+        }
+        const AssetArchiveEntry * entries = (const AssetArchiveEntry *)(mapping.data() + sizeof(AssetArchiveHeader));
+        for (uint32_t i = 0; i < header->entryCount; ++i)
+            if (entries[i].offset + entries[i].size > mapping.size()
+                || (uint64_t)entries[i].nameOffset + entries[i].nameLength > header->namesSize)
+            {
+                std::cout << "WARNING::ASSET_ARCHIVE::INVALID " << path << std::endl;
+                return false;
+            }
+
+        m_mapping = std::move(mapping);
+        m_header = header;
+        m_entries = entries;
+        m_slots = (const uint32_t *)(m_entries + header->entryCount);
+        m_root = root;
+        return true;
+    }
+
+    bool active () const
+    {
+        return m_header != NULL;
+    }
+
+    unsigned int entryCount () const
+    {
+        return m_header ? m_header->entryCount : 0;
+    }
+
+    size_t bytes () const
+    {
+        return m_mapping.size();
+    }
+
+    // hot reload: the loose file at `path` was edited, it wins over its entry from now on
+    void markEdited (const std::string & path)
+    {
+        std::lock_guard<std::mutex> lock(m_editedMutex);
+        m_edited.insert(path);
+    }
+
+    bool edited (const std::string & path) const
+    {
+        std::lock_guard<std::mutex> lock(m_editedMutex);
+        return m_edited.count(path) != 0;
+    }
+
+    const AssetArchiveEntry * find (const std::string & name) const
+    {
+        if (!m_header)
+            return NULL;
+        uint64_t hash = hashBytes((const unsigned char *)name.c_str(), name.size());
+        uint32_t mask = m_header->slotCount - 1;
+        for (uint32_t probe = 0; probe <= mask; ++probe)
+        {
+            uint32_t slot = m_slots[(hash + probe) & mask];
+            if (slot == 0 || slot > m_header->entryCount)
+                return NULL;
+            const AssetArchiveEntry & entry = m_entries[slot - 1];
+            if (entry.nameHash == hash && entry.nameLength == name.size()
+                && memcmp(names() + entry.nameOffset, name.c_str(), name.size()) == 0)
+                return &entry;
+        }
+        return NULL;
+    }
+
+    // safe from any thread once open() returned
+    bool read (const std::string & path, AssetData & asset) const
+    {
+        if (!m_header || path.compare(0, m_root.size(), m_root) != 0)
+            return false;
+        const AssetArchiveEntry * entry = find(path.substr(m_root.size()));
+        if (!entry)
+            return false;
+        const unsigned char * payload = m_mapping.data() + entry->offset;
+        if (entry->codec == ASSET_STORED)
+        {
+            asset.data = payload;
+            asset.size = entry->size;
+            return true;
+        }
+        if (entry->codec != ASSET_LZ4)
+            return false;
+        asset.storage.resize(entry->rawSize);
+        if (!lz4Decompress(payload, entry->size, asset.storage.data(), entry->rawSize))
+        {
+            std::cout << "ERROR::ASSET_ARCHIVE::CORRUPT_ENTRY " << path << std::endl;
+            return false;
+        }
+        asset.data = asset.storage.data();
+        asset.size = asset.storage.size();
+        return true;
+    }
+
+private:
+    MappedFile m_mapping;
+    const AssetArchiveHeader * m_header;
+    const AssetArchiveEntry * m_entries;
+    const uint32_t * m_slots; // entry index + 1, 0 for an empty slot
+    std::string m_root;
+    std::unordered_set<std::string> m_edited; // paths as handed to read()
+    mutable std::mutex m_editedMutex;         // marked on the GL thread, read by the decoders
+
+    const char * names () const
+    {
+        return (const char *)m_mapping.data() + m_header->namesOffset;
+    }
+};
+
+inline AssetArchive & assetArchive ()
+{
+    static AssetArchive archive;
+    return archive;
+}
+
+// from the archive when it has the path and it was not edited since, else the loose file
+inline bool openAsset (const char * path, AssetData & asset)
+{
+    if (!assetArchive().edited(path) && assetArchive().read(path, asset))
+        return true;
+    if (!asset.file.open(path))
+        return false;
+    asset.data = asset.file.data();
+    asset.size = asset.file.size();
+    return true;
+}
+
+// the packer side; lz4 keeps an entry compressed only where that saves an eighth
+// -------------------------------------------------------------------------------
+inline bool writeAssetArchive (const std::string & path, const std::vector<AssetSource> & sources, bool lz4)
+{
+    AssetArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GPAK", 4);
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entryCount = sources.size();
+    header.slotCount = 1;
+    while (header.slotCount < 2 * sources.size())
+        header.slotCount *= 2;
+
+    std::vector<AssetArchiveEntry> entries(sources.size());
+    std::vector<uint32_t> slots(header.slotCount, 0);
+    std::string names;
+    std::vector<std::vector<unsigned char>> payloads(sources.size());
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        const AssetSource & source = sources[i];
+        AssetArchiveEntry & entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.nameHash = hashBytes((const unsigned char *)source.name.c_str(), source.name.size());
+        entry.nameOffset = names.size();
+        entry.nameLength = source.name.size();
+        names += source.name;
+
+        uint32_t mask = header.slotCount - 1, probe = 0;
+        while (slots[(entry.nameHash + probe) & mask])
+            probe++;
+        slots[(entry.nameHash + probe) & mask] = i + 1;
+
+        entry.rawSize = source.bytes.size();
+        entry.codec = ASSET_STORED;
+        if (lz4 && !source.bytes.empty())
+        {
+            lz4Compress(source.bytes.data(), source.bytes.size(), payloads[i]);
+            if (payloads[i].size() <= source.bytes.size() - source.bytes.size() / 8)
+                entry.codec = ASSET_LZ4;
+        }
+        if (entry.codec == ASSET_STORED)
+            payloads[i] = source.bytes;
+        entry.size = payloads[i].size();
+    }
+
+    header.namesOffset = sizeof(header) + entries.size() * sizeof(AssetArchiveEntry) + slots.size() * sizeof(uint32_t);
+    header.namesSize = names.size();
+    uint64_t offset = header.namesOffset + header.namesSize;
+    for (AssetArchiveEntry & entry : entries)
+    {
+        offset = (offset + ASSET_ARCHIVE_ALIGNMENT - 1) & ~(ASSET_ARCHIVE_ALIGNMENT - 1);
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    // temporary name first, like the texture and program caches
+    std::string temp = path + ".tmp";
+    FILE * file = fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(entries.data(), sizeof(AssetArchiveEntry), entries.size(), file) == entries.size();
+    ok = ok && fwrite(slots.data(), sizeof(uint32_t), slots.size(), file) == slots.size();
+    ok = ok && fwrite(names.data(), 1, names.size(), file) == names.size();
+    uint64_t position = header.namesOffset + header.namesSize;
+    const unsigned char zeros[ASSET_ARCHIVE_ALIGNMENT] = { 0 };
+    for (unsigned int i = 0; ok && i < entries.size(); ++i)
+    {
+        ok = fwrite(zeros, 1, entries[i].offset - position, file) == entries[i].offset - position;
+        ok = ok && fwrite(payloads[i].data(), 1, payloads[i].size(), file) == payloads[i].size();
+        position = entries[i].offset + entries[i].size;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(temp.c_str());
+    return ok;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+
+// timing loop shared by the bench_* tools (src/bench_*.cpp)
+// ----------------------------------------------------------
+
+// mean wall time of `runs` calls of work, in milliseconds
+template <typename F>
+double timedMs (F work, int runs)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < runs; ++i)
+        work();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / runs;
+}
+
+// the same after one untimed call, which warms the page cache, the allocator and
+// the driver
+template <typename F>
+double averageMs (F work, int runs)
+{
+    work();
+    return timedMs(work, runs);
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// --bench: time advances a fixed step per frame instead of following the clock and
+// the camera flies a scripted path, so every run renders the same frames. The
+// warm-up frames (shader compiles, texture streaming) are left out, and the warm-up
+// runs on, holding its last frame's time, until nothing is compiling or streaming
+// in any more. The measured frames give CPU frame times (start to start, swap
+// included) and GPU frame times (GL_TIMESTAMP at the start and at the end of the
+// frame's commands)
+// --------------------------------------------------------------------------------
+
+const double BENCH_STEP = 1.0 / 60.0;
+
+// extra warm-up frames at most, for streaming that never settles
+const unsigned int BENCH_SETTLE_LIMIT = 3600;
+
+// frames whose GPU timestamps may still be in flight
+const int BENCH_QUERY_RING = 8;
+
+// one slow orbit of the scene per 20 seconds, bobbing between eye and crowd height
+inline glm::vec3 benchCameraPosition (double time)
+{
+    double angle = time * 2.0 * 3.14159265358979 / 20.0;
+    return glm::vec3(15.0 * sin(angle), 2.0 + 3.0 * sin(angle * 3.0), 15.0 * cos(angle));
+}
+
+class FrameBenchmark {
+public:
+    unsigned int m_warmup, m_measured;
+    // frames the warm-up ran past m_warmup waiting for compiles and uploads
+    unsigned int m_settle;
+
+    FrameBenchmark (unsigned int warmup = 60, unsigned int measured = 600)
+        : m_warmup(warmup), m_measured(measured), m_settle(0), m_frame(0), m_issued(0), m_read(0)
+    {
+        for (int i = 0; i < BENCH_QUERY_RING; ++i)
+            m_queries[i][0] = m_queries[i][1] = 0;
+    }
+
+    // needs a current GL context
+    void init ()
+    {
+        for (int i = 0; i < BENCH_QUERY_RING; ++i)
+            glGenQueries(2, m_queries[i]);
+    }
+
+    // simulated time of the frame about to start
+    double time () const
+    {
+        return (m_frame - m_settle) * BENCH_STEP;
+    }
+
+    bool done () const
+    {
+        return m_frame >= firstMeasured() + m_measured;
+    }
+
+    // `busy`: shaders still compiling or textures still streaming in, which
+    // holds the first measured frame back
+    void beginFrame (bool busy = false)
+    {
+        if (busy && m_frame == firstMeasured() && m_settle < BENCH_SETTLE_LIMIT)
+            m_settle++;
+        auto now = std::chrono::high_resolution_clock::now();
+        if (m_frame > firstMeasured())
+        {
+            std::chrono::duration<double, std::milli> elapsed = now - m_start;
+            m_cpuMs.push_back(elapsed.count());
+        }
+        m_start = now;
+        if (measuring())
+        {
+            // the ring is full: the oldest frame is BENCH_QUERY_RING frames old
+            if (m_issued - m_read >= (unsigned int)BENCH_QUERY_RING)
+                read(true);
+            glQueryCounter(m_queries[m_issued % BENCH_QUERY_RING][0], GL_TIMESTAMP);
+        }
+    }
+
+    // after the frame's last command, before the swap
+    void endFrame ()
+    {
+        if (measuring())
+        {
+            glQueryCounter(m_queries[m_issued % BENCH_QUERY_RING][1], GL_TIMESTAMP);
+            m_issued++;
+            while (m_read < m_issued && read(false)) {}
+        }
+        m_frame++;
+    }
+
+    // after the last frame: waits for the outstanding GPU times and returns the
+    // percentiles as JSON
+    std::string report (int width, int height)
+    {
+        // the last frame's CPU time ends here
+        beginFrame();
+        while (m_read < m_issued)
+            read(true);
+
+        char header[256];
+        snprintf(header, sizeof(header),
+                 "{\n  \"warmup_frames\": %u,\n  \"settle_frames\": %u,\n  \"measured_frames\": %u,\n  \"step_ms\": %.3f,\n"
+                 "  \"width\": %d,\n  \"height\": %d,\n",
+                 m_warmup, m_settle, m_measured, BENCH_STEP * 1000.0, width, height);
+        return std::string(header) + "  \"cpu_ms\": " + summary(m_cpuMs) + ",\n  \"gpu_ms\": " + summary(m_gpuMs) + "\n}\n";
+    }
+
+private:
+    unsigned int m_frame;
+    std::chrono::high_resolution_clock::time_point m_start;
+    unsigned int m_queries[BENCH_QUERY_RING][2]; // start, end timestamp
+    unsigned int m_issued, m_read;
+    std::vector<double> m_cpuMs, m_gpuMs;
+
+    unsigned int firstMeasured () const
+    {
+        return m_warmup + m_settle;
+    }
+
+    bool measuring () const
+    {
+        return m_frame >= firstMeasured() && !done();
+    }
+
+    bool read (bool wait)
+    {
+        unsigned int * queries = m_queries[m_read % BENCH_QUERY_RING];
+        GLint available = GL_TRUE;
+        if (!wait)
+            glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+        GLuint64 start, end;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+        m_gpuMs.push_back((end - start) / 1.0e6);
+        m_read++;
+        return true;
+    }
+
+    // nearest rank percentiles
+    static std::string summary (std::vector<double> samples)
+    {
+        if (samples.empty())
+            return "null";
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        auto percentile = [&](double p) {
+            size_t rank = (size_t)std::ceil(p / 100.0 * samples.size());
+            return samples[std::max<size_t>(rank, 1) - 1];
+        };
+        char text[256];
+        snprintf(text, sizeof(text), "{ \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }",
+                 sum / samples.size(), percentile(50.0), percentile(95.0), percentile(99.0), samples.back());
+        return text;
+    }
+};
@@ -0,0 +1,484 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "MipGen.hpp"
+
+// BC1/BC3 (S3TC) and BC4/BC5 (RGTC) block encoders and decoders. Every 4x4 block
+// is encoded independently, so block rows of a level are split across threads.
+// -------------------------------------------------------------------------------
+
+// S3TC is an extension, glad only carries the core enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum BCQuality {
+    BC_QUALITY_FAST, // bounding box endpoints
+    BC_QUALITY_HIGH  // principal axis endpoints, refined by least squares
+};
+
+// import settings, read by the decode workers; set before textures are requested
+struct TextureCompressionSettings {
+    bool enabled;
+    BCQuality quality;
+    unsigned int threads; // 0 = hardware concurrency
+    bool s3tcSupported;   // filled in by queryTextureCompression()
+
+    TextureCompressionSettings ()
+        : enabled(true), quality(BC_QUALITY_HIGH), threads(0), s3tcSupported(false) {}
+};
+
+inline TextureCompressionSettings & textureCompression ()
+{
+    static TextureCompressionSettings settings;
+    return settings;
+}
+
+// needs a current GL context; RGTC is core since 3.0, S3TC has to be advertised
+inline void queryTextureCompression ()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char * name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            textureCompression().s3tcSupported = true;
+    }
+}
+
+// format choice by channel count: BC4 grey, BC5 two channel, BC1 RGB, BC3 RGBA
+inline GLenum blockFormat (int channels)
+{
+    switch (channels)
+    {
+    case 1: return GL_COMPRESSED_RED_RGTC1;
+    case 2: return GL_COMPRESSED_RG_RGTC2;
+    case 3: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    default: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+}
+
+inline bool blockFormatSupported (GLenum format)
+{
+    if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        return textureCompression().s3tcSupported;
+    return true;
+}
+
+inline unsigned int blockBytes (GLenum format)
+{
+    return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+}
+
+inline const char * blockFormatName (GLenum format)
+{
+    switch (format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+    case GL_COMPRESSED_RED_RGTC1: return "BC4";
+    case GL_COMPRESSED_RG_RGTC2: return "BC5";
+    default: return "raw";
+    }
+}
+
+inline size_t compressedLevelSize (GLenum format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// BC1 colour block
+// ----------------
+inline uint16_t packColor565 (const float * rgb)
+{
+    int r = std::min(31, std::max(0, (int)(rgb[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, (int)(rgb[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, (int)(rgb[2] * 31.0f / 255.0f + 0.5f)));
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+inline void unpackColor565 (uint16_t color, int * rgb)
+{
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+// four colour palette; colour blocks of BC3 always decode this way
+inline void bc1Palette (uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpackColor565(c0, palette[0]);
+    unpackColor565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// pick indices for a pair of 565 endpoints, returns the squared error
+inline int bc1Indices (uint16_t c0, uint16_t c1, const unsigned char pixels[16][4], uint32_t & indices)
+{
+    int palette[4][3];
+    bc1Palette(c0, c1, palette);
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 4; ++p)
+        {
+            int dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+            int e = dr * dr + dg * dg + db * db;
+            if (e < bestError)
+            {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+        error += bestError;
+    }
+    return error;
+}
+
+// quantise float endpoints and order them for four colour mode
+inline int bc1Try (const float * a, const float * b, const unsigned char pixels[16][4], uint16_t & c0, uint16_t & c1, uint32_t & indices)
+{
+    c0 = packColor565(a);
+    c1 = packColor565(b);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    return bc1Indices(c0, c1, pixels, indices);
+}
+
+// least squares endpoints for a fixed index assignment
+inline bool bc1Refine (const unsigned char pixels[16][4], uint32_t indices, float * a, float * b)
+{
+    static const float WEIGHT0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+    {
+        float w0 = WEIGHT0[(indices >> (2 * i)) & 3], w1 = 1.0f - w0;
+        aa += w0 * w0;
+        ab += w0 * w1;
+        bb += w1 * w1;
+        for (int c = 0; c < 3; ++c)
+        {
+            ax[c] += w0 * pixels[i][c];
+            bx[c] += w1 * pixels[i][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; ++c)
+    {
+        a[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / det));
+        b[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / det));
+    }
+    return true;
+}
+
+inline void encodeBC1Block (const unsigned char pixels[16][4], BCQuality quality, unsigned char * out)
+{
+    float mean[3] = { 0, 0, 0 }, lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+        {
+            mean[c] += pixels[i][c] / 16.0f;
+            lo[c] = std::min(lo[c], (float)pixels[i][c]);
+            hi[c] = std::max(hi[c], (float)pixels[i][c]);
+        }
+
+    float a[3], b[3];
+    if (quality == BC_QUALITY_FAST)
+    {
+        // bounding box, inset a little since the extremes are rarely hit exactly
+        for (int c = 0; c < 3; ++c)
+        {
+            float inset = (hi[c] - lo[c]) / 16.0f;
+            a[c] = hi[c] - inset;
+            b[c] = lo[c] + inset;
+        }
+    }
+    else
+    {
+        // principal axis of the colours by power iteration on the covariance
+        float cov[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], bl = pixels[i][2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * bl;
+            cov[3] += g * g; cov[4] += g * bl; cov[5] += bl * bl;
+        }
+        float axis[3] = { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] };
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float tMin = 0, tMax = 0;
+        for (int i = 0; axisLength > 1e-6f && i < 16; ++i)
+        {
+            float t = ((pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2]) / axisLength;
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            a[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMax));
+            b[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMin));
+        }
+    }
+
+    uint16_t c0, c1;
+    uint32_t indices;
+    int error = bc1Try(a, b, pixels, c0, c1, indices);
+
+    // a couple of least squares passes, keeping whichever endpoints did best
+    for (int pass = 0; quality == BC_QUALITY_HIGH && pass < 2 && error > 0; ++pass)
+    {
+        if (c0 == c1 || !bc1Refine(pixels, indices, a, b))
+            break;
+        uint16_t r0, r1;
+        uint32_t refined;
+        int refinedError = bc1Try(a, b, pixels, r0, r1, refined);
+        if (refinedError >= error)
+            break;
+        error = refinedError;
+        c0 = r0;
+        c1 = r1;
+        indices = refined;
+    }
+
+    // equal endpoints would select three colour mode, every index 0 is the same colour there
+    if (c0 == c1)
+        indices = 0;
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+inline void decodeBC1Block (const unsigned char * block, unsigned char pixels[16][4])
+{
+    uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+    uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+    int palette[4][3];
+    bc1Palette(c0, c1, palette);
+    for (int i = 0; i < 16; ++i)
+    {
+        int index = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; ++c)
+            pixels[i][c] = palette[index][c];
+    }
+}
+
+// BC4 single channel block (BC3 alpha, both halves of BC5)
+// --------------------------------------------------------
+inline void bc4Palette (int v0, int v1, int palette[8])
+{
+    palette[0] = v0;
+    palette[1] = v1;
+    if (v0 > v1)
+        for (int k = 1; k < 7; ++k)
+            palette[k + 1] = ((7 - k) * v0 + k * v1 + 3) / 7;
+    else
+    {
+        for (int k = 1; k < 5; ++k)
+            palette[k + 1] = ((5 - k) * v0 + k * v1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+inline int bc4Indices (int v0, int v1, const unsigned char values[16], uint64_t & indices)
+{
+    int palette[8];
+    bc4Palette(v0, v1, palette);
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 8; ++p)
+        {
+            int e = (values[i] - palette[p]) * (values[i] - palette[p]);
+            if (e < bestError)
+            {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= (uint64_t)best << (3 * i);
+        error += bestError;
+    }
+    return error;
+}
+
+inline void encodeBC4Block (const unsigned char values[16], BCQuality quality, unsigned char * out)
+{
+    int lo = 255, hi = 0, innerLo = 255, innerHi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = std::min(lo, (int)values[i]);
+        hi = std::max(hi, (int)values[i]);
+        if (values[i] != 0 && values[i] != 255)
+        {
+            innerLo = std::min(innerLo, (int)values[i]);
+            innerHi = std::max(innerHi, (int)values[i]);
+        }
+    }
+
+    // eight interpolated values between the extremes
+    int v0 = hi, v1 = lo;
+    uint64_t indices;
+    int error = bc4Indices(v0, v1, values, indices);
+
+    // six values plus exact 0 and 255 wins when the block has hard black/white texels
+    if (quality == BC_QUALITY_HIGH && error > 0 && innerLo <= innerHi)
+    {
+        uint64_t sixIndices;
+        int sixError = bc4Indices(innerLo, innerHi, values, sixIndices);
+        if (sixError < error)
+        {
+            v0 = innerLo;
+            v1 = innerHi;
+            indices = sixIndices;
+        }
+    }
+
+    out[0] = v0;
+    out[1] = v1;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+inline void decodeBC4Block (const unsigned char * block, unsigned char values[16])
+{
+    int palette[8];
+    bc4Palette(block[0], block[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+// whole levels
+// ------------
+// gather a 4x4 block as RGBA, replicating the last row/column past the edge
+inline void fetchBlock (const unsigned char * pixels, int width, int height, int channels, int bx, int by, unsigned char block[16][4])
+{
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x)
+        {
+            int sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+            const unsigned char * src = pixels + ((size_t)sy * width + sx) * channels;
+            unsigned char * dst = block[y * 4 + x];
+            dst[0] = dst[1] = dst[2] = 0;
+            dst[3] = 255;
+            for (int c = 0; c < channels; ++c)
+                dst[c] = src[c];
+        }
+}
+
+inline void compressLevel (const unsigned char * pixels, int width, int height, int channels, GLenum format,
+                           BCQuality quality, unsigned int threads, unsigned char * out)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    unsigned int size = blockBytes(format);
+    parallelRows(blocksHigh, threads, [&](int begin, int end) {
+        unsigned char block[16][4], channel[16];
+        for (int by = begin; by < end; ++by)
+            for (int bx = 0; bx < blocksWide; ++bx)
+            {
+                fetchBlock(pixels, width, height, channels, bx, by, block);
+                unsigned char * dst = out + ((size_t)by * blocksWide + bx) * size;
+                if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                    encodeBC1Block(block, quality, dst);
+                else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                {
+                    for (int i = 0; i < 16; ++i)
+                        channel[i] = block[i][3];
+                    encodeBC4Block(channel, quality, dst);
+                    encodeBC1Block(block, quality, dst + 8);
+                }
+                else
+                {
+                    // RGTC: one BC4 block per channel
+                    for (unsigned int c = 0; c < size / 8; ++c)
+                    {
+                        for (int i = 0; i < 16; ++i)
+                            channel[i] = block[i][c];
+                        encodeBC4Block(channel, quality, dst + 8 * c);
+                    }
+                }
+            }
+    });
+}
+
+// software path for drivers without the format, writes `channels` tightly packed
+inline void decompressLevel (const unsigned char * blocks, int width, int height, GLenum format, int channels, unsigned char * out)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    unsigned int size = blockBytes(format);
+    unsigned char block[16][4], channel[16];
+    for (int by = 0; by < blocksHigh; ++by)
+        for (int bx = 0; bx < blocksWide; ++bx)
+        {
+            const unsigned char * src = blocks + ((size_t)by * blocksWide + bx) * size;
+            memset(block, 255, sizeof(block));
+            if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                decodeBC1Block(src, block);
+            else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            {
+                decodeBC4Block(src, channel);
+                decodeBC1Block(src + 8, block);
+                for (int i = 0; i < 16; ++i)
+                    block[i][3] = channel[i];
+            }
+            else
+            {
+                for (unsigned int c = 0; c < size / 8; ++c)
+                {
+                    decodeBC4Block(src + 8 * c, channel);
+                    for (int i = 0; i < 16; ++i)
+                        block[i][c] = channel[i];
+                }
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+                for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+                    memcpy(out + ((size_t)(by * 4 + y) * width + bx * 4 + x) * channels, block[y * 4 + x], channels);
+        }
+}
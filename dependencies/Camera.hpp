@@ -66,6 +66,17 @@ public:
         return glm::lookAt(Position,Front + Position, Up);
     }
 
+    // place the camera at position facing target (scripted paths)
+    // ------------------------------------------------------------
+
+    void LookAt (const glm::vec3 & position, const glm::vec3 & target) {
+        glm::vec3 direction = glm::normalize(target - position);
+        Position = position;
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(direction.y));
+        updateCameraVectors();
+    }
+
     // handle inputs
     // -------------
 
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Shader.hpp"
+#include "WorkerPool.hpp"
+
+// clustered forward lighting: the view frustum is cut into CLUSTER_X x CLUSTER_Y
+// screen tiles times CLUSTER_Z exponential depth slices, every frame each cluster
+// gets the list of lights whose sphere reaches into it. Binning runs on the CPU,
+// slices split across the worker pool and four lights per SSE test; the result
+// goes to the GPU as three buffer textures read by shadeLights in lighting.glsl
+// -------------------------------------------------------------------------------
+
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// vec4 texels per light in the light data buffer
+const int LIGHT_TEXELS = 3;
+
+enum LightType {
+    LIGHT_POINT,
+    LIGHT_SPOT
+};
+
+// a point or spot light; nothing is lit past `radius`
+struct SceneLight {
+    LightType type;
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    glm::vec3 direction;             // spot lights only
+    float innerDegrees, outerDegrees; // full intensity inside inner, none outside outer
+
+    SceneLight ()
+        : type(LIGHT_POINT), position(0.0f), radius(5.0f), color(1.0f), direction(0.0f, -1.0f, 0.0f),
+          innerDegrees(20.0f), outerDegrees(30.0f) {}
+};
+
+// `count` lights of random colors over the robot and the crowd behind it,
+// every fourth one a spot light pointing down
+inline void scatterLights (std::vector<SceneLight> & lights, unsigned int count)
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    lights.resize(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        SceneLight & light = lights[i];
+        light = SceneLight();
+        light.type = i % 4 == 3 ? LIGHT_SPOT : LIGHT_POINT;
+        light.position = glm::vec3(-20.0f + 40.0f * unit(random), -3.0f + 7.0f * unit(random), -50.0f + 60.0f * unit(random));
+        light.radius = 2.5f + 3.0f * unit(random);
+        // saturated hue, never too dark
+        float hue = 6.0f * unit(random);
+        light.color = glm::clamp(glm::vec3(fabs(hue - 3.0f) - 1.0f, 2.0f - fabs(hue - 2.0f), 2.0f - fabs(hue - 4.0f)), 0.0f, 1.0f);
+    }
+}
+
+class ClusteredLights {
+public:
+    // last update: lights binned, cluster references, longest cluster list, threads used
+    unsigned int m_lights, m_references, m_maxPerCluster, m_threads;
+    double m_binMs;
+
+    ClusteredLights ()
+        : m_lights(0), m_references(0), m_maxPerCluster(0), m_threads(0), m_binMs(0.0),
+          m_lightBuffer(0), m_gridBuffer(0), m_indexBuffer(0), m_lightTexture(0), m_gridTexture(0), m_indexTexture(0),
+          m_width(0), m_height(0), m_near(0.0f), m_far(0.0f), m_projection(0.0f), m_depthRow(0.0f) {}
+
+    // needs a current GL context
+    void init ()
+    {
+        glGenBuffers(1, &m_lightBuffer);
+        glGenBuffers(1, &m_gridBuffer);
+        glGenBuffers(1, &m_indexBuffer);
+        glGenTextures(1, &m_lightTexture);
+        glGenTextures(1, &m_gridTexture);
+        glGenTextures(1, &m_indexTexture);
+
+        // the textures keep pointing at their buffer however often it is reallocated
+        attach(m_lightTexture, m_lightBuffer, GL_RGBA32F);
+        attach(m_gridTexture, m_gridBuffer, GL_RG32UI);
+        attach(m_indexTexture, m_indexBuffer, GL_R32UI);
+        m_grid.assign(2 * CLUSTER_COUNT, 0);
+        upload(std::vector<glm::vec4>(LIGHT_TEXELS), m_grid, std::vector<uint32_t>(1, 0));
+    }
+
+    // bin `lights` for this view and upload the lists; near and far must match projection
+    void update (const std::vector<SceneLight> & lights, const glm::mat4 & view, const glm::mat4 & projection,
+                 float nearPlane, float farPlane, int width, int height)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (width != m_width || height != m_height || nearPlane != m_near || farPlane != m_far || projection != m_projection)
+            buildClusters(projection, nearPlane, farPlane, width, height);
+        // the view's z row: lighting.glsl gets view space depth from a world position with it
+        m_depthRow = glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+
+        // light data in world space for the shader, view space spheres for the binning
+        std::vector<glm::vec4> data(std::max<size_t>(1, lights.size()) * LIGHT_TEXELS, glm::vec4(0.0f));
+        m_centers.resize(lights.size());
+        m_radii.resize(lights.size());
+        for (unsigned int i = 0; i < lights.size(); ++i)
+        {
+            const SceneLight & light = lights[i];
+            bool spot = light.type == LIGHT_SPOT;
+            // a point light is a spot whose cone never ends: smoothstep(-2, -1, cos) is always 1
+            float outer = spot ? cos(glm::radians(light.outerDegrees)) : -2.0f;
+            float inner = spot ? cos(glm::radians(light.innerDegrees)) : -1.0f;
+            data[i * LIGHT_TEXELS + 0] = glm::vec4(light.position, light.radius);
+            data[i * LIGHT_TEXELS + 1] = glm::vec4(light.color, outer);
+            data[i * LIGHT_TEXELS + 2] = glm::vec4(spot ? glm::normalize(light.direction) : glm::vec3(0.0f, -1.0f, 0.0f), inner);
+            m_centers[i] = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            m_radii[i] = light.radius;
+        }
+
+        // slices are independent, a few per thread once there is enough work
+        std::vector<std::vector<uint32_t>> sliceIndices(CLUSTER_Z);
+        unsigned int threads = lights.size() < 64 ? 1 : std::min(workerPool().size(), (unsigned int)CLUSTER_Z / 4);
+        int step = (CLUSTER_Z + threads - 1) / threads;
+        workerPool().run(threads, [&](int t) {
+            int begin = t * step, end = std::min(CLUSTER_Z, begin + step);
+            if (begin < end)
+                binSlices(begin, end, sliceIndices);
+        }, threads);
+
+        // slice lists back to back, grid offsets made absolute
+        std::vector<uint32_t> indices;
+        m_maxPerCluster = 0;
+        for (int z = 0; z < CLUSTER_Z; ++z)
+        {
+            uint32_t base = indices.size();
+            for (int cluster = z * CLUSTER_X * CLUSTER_Y; cluster < (z + 1) * CLUSTER_X * CLUSTER_Y; ++cluster)
+            {
+                m_grid[2 * cluster] += base;
+                m_maxPerCluster = std::max(m_maxPerCluster, m_grid[2 * cluster + 1]);
+            }
+            indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+        }
+        m_lights = lights.size();
+        m_references = indices.size();
+        m_threads = threads;
+        if (indices.empty())
+            indices.push_back(0);
+        upload(data, m_grid, indices);
+        m_binMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // buffer textures on units first..first+2 and the uniforms of lighting.glsl
+    void bind (const Shader & shader, unsigned int firstUnit = 6) const
+    {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, m_gridTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, m_indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.use();
+        shader.setInt("lightData", firstUnit);
+        shader.setInt("clusterGrid", firstUnit + 1);
+        shader.setInt("clusterLights", firstUnit + 2);
+        shader.setVec3("clusterCount", glm::vec3(CLUSTER_X, CLUSTER_Y, CLUSTER_Z));
+        // tile from gl_FragCoord, slice from log(view depth)
+        float sliceScale = CLUSTER_Z / log(m_far / m_near);
+        shader.setVec4("clusterScale", glm::vec4((float)CLUSTER_X / m_width, (float)CLUSTER_Y / m_height, sliceScale, -log(m_near) * sliceScale));
+        shader.setVec4("clusterDepth", m_depthRow);
+    }
+
+private:
+    unsigned int m_lightBuffer, m_gridBuffer, m_indexBuffer;
+    unsigned int m_lightTexture, m_gridTexture, m_indexTexture;
+
+    // cluster bounds in view space, rebuilt when the projection or viewport changes
+    int m_width, m_height;
+    float m_near, m_far;
+    glm::mat4 m_projection;
+    std::vector<glm::vec3> m_min, m_max;
+    std::vector<float> m_sliceNear, m_sliceFar; // view depth, positive
+
+    std::vector<glm::vec3> m_centers; // view space
+    std::vector<float> m_radii;
+    std::vector<uint32_t> m_grid;     // (first index, count) per cluster
+    glm::vec4 m_depthRow;
+
+    static void attach (unsigned int texture, unsigned int buffer, GLenum format)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // a fresh allocation each frame so the driver never waits on last frame's reads
+    void upload (const std::vector<glm::vec4> & data, const std::vector<uint32_t> & grid, const std::vector<uint32_t> & indices) const
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_gridBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(uint32_t), grid.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_indexBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // view space AABB of every cluster: the tile's corner rays cut at the slice's depths
+    void buildClusters (const glm::mat4 & projection, float nearPlane, float farPlane, int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        m_near = nearPlane;
+        m_far = farPlane;
+        m_projection = projection;
+        m_min.resize(CLUSTER_COUNT);
+        m_max.resize(CLUSTER_COUNT);
+        m_sliceNear.resize(CLUSTER_Z);
+        m_sliceFar.resize(CLUSTER_Z);
+
+        glm::mat4 inverse = glm::inverse(projection);
+        for (int z = 0; z < CLUSTER_Z; ++z)
+        {
+            m_sliceNear[z] = nearPlane * pow(farPlane / nearPlane, (float)z / CLUSTER_Z);
+            m_sliceFar[z] = nearPlane * pow(farPlane / nearPlane, (float)(z + 1) / CLUSTER_Z);
+        }
+        for (int y = 0; y < CLUSTER_Y; ++y)
+            for (int x = 0; x < CLUSTER_X; ++x)
+            {
+                // the tile's corners as view space directions with z = -1
+                glm::vec3 rays[4];
+                for (int corner = 0; corner < 4; ++corner)
+                {
+                    glm::vec2 ndc(-1.0f + 2.0f * (x + (corner & 1)) / CLUSTER_X, -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTER_Y);
+                    glm::vec4 point = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+                    glm::vec3 direction = glm::vec3(point) / point.w;
+                    rays[corner] = direction / -direction.z;
+                }
+                for (int z = 0; z < CLUSTER_Z; ++z)
+                {
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    for (const glm::vec3 & ray : rays)
+                        for (float depth : { m_sliceNear[z], m_sliceFar[z] })
+                        {
+                            low = glm::min(low, ray * depth);
+                            high = glm::max(high, ray * depth);
+                        }
+                    int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    m_min[cluster] = low;
+                    m_max[cluster] = high;
+                }
+            }
+    }
+
+    // sphere against box for every cluster of slices [begin, end)
+    void binSlices (int begin, int end, std::vector<std::vector<uint32_t>> & sliceIndices)
+    {
+        // lights reaching into the slice, structure of arrays padded to four; the
+        // padding sits far away so it never passes the test
+        std::vector<float> cx, cy, cz, r2;
+        std::vector<uint32_t> ids;
+        for (int z = begin; z < end; ++z)
+        {
+            cx.clear(); cy.clear(); cz.clear(); r2.clear(); ids.clear();
+            for (unsigned int i = 0; i < m_centers.size(); ++i)
+            {
+                float depth = -m_centers[i].z;
+                if (depth + m_radii[i] < m_sliceNear[z] || depth - m_radii[i] > m_sliceFar[z])
+                    continue;
+                cx.push_back(m_centers[i].x);
+                cy.push_back(m_centers[i].y);
+                cz.push_back(m_centers[i].z);
+                r2.push_back(m_radii[i] * m_radii[i]);
+                ids.push_back(i);
+            }
+            while (cx.size() % 4)
+            {
+                cx.push_back(1e30f);
+                cy.push_back(1e30f);
+                cz.push_back(1e30f);
+                r2.push_back(0.0f);
+                ids.push_back(0);
+            }
+
+            std::vector<uint32_t> & out = sliceIndices[z];
+            out.clear();
+            for (int cluster = z * CLUSTER_X * CLUSTER_Y; cluster < (z + 1) * CLUSTER_X * CLUSTER_Y; ++cluster)
+            {
+                m_grid[2 * cluster] = out.size(); // relative to the slice until update() merges
+                const glm::vec3 & low = m_min[cluster], & high = m_max[cluster];
+                for (size_t i = 0; i < cx.size(); i += 4)
+                {
+#if defined(__SSE2__)
+                    // squared distance from each center to the box, clamped per axis
+                    __m128 zero = _mm_setzero_ps();
+                    __m128 x = _mm_loadu_ps(&cx[i]), y = _mm_loadu_ps(&cy[i]), zc = _mm_loadu_ps(&cz[i]);
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(low.x), x), _mm_sub_ps(x, _mm_set1_ps(high.x))), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(low.y), y), _mm_sub_ps(y, _mm_set1_ps(high.y))), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(low.z), zc), _mm_sub_ps(zc, _mm_set1_ps(high.z))), zero);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int hits = _mm_movemask_ps(_mm_cmple_ps(distance, _mm_loadu_ps(&r2[i])));
+#else
+                    int hits = 0;
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        float dx = std::max(std::max(low.x - cx[i + lane], cx[i + lane] - high.x), 0.0f);
+                        float dy = std::max(std::max(low.y - cy[i + lane], cy[i + lane] - high.y), 0.0f);
+                        float dz = std::max(std::max(low.z - cz[i + lane], cz[i + lane] - high.z), 0.0f);
+                        if (dx * dx + dy * dy + dz * dz <= r2[i + lane])
+                            hits |= 1 << lane;
+                    }
+#endif
+                    for (int lane = 0; lane < 4; ++lane)
+                        if (hits & (1 << lane))
+                            out.push_back(ids[i + lane]);
+                }
+                m_grid[2 * cluster + 1] = out.size() - m_grid[2 * cluster];
+            }
+        }
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <unordered_map>
+
+#include "RenderTarget.hpp"
+#include "Shader.hpp"
+
+// deferred path: lit nodes draw their DEFERRED shader variant into a compact
+// G-buffer, then one fullscreen pass (deferred_fragment.glsl) shades every covered
+// pixel once, clustered lights included. Per pixel: albedo in RGBA8, octahedral
+// normal + specular strength + shininess in RGBA16, and the depth the position is
+// rebuilt from. Unlit nodes draw forward afterwards against the restored depth
+// --------------------------------------------------------------------------------
+
+// texture units the G-buffer is read from, clear of the ones the lit shaders sample
+const int DEFERRED_FIRST_UNIT = 9;
+
+class DeferredRenderer {
+public:
+    DeferredRenderer ()
+        : m_FBO(0), m_albedo(0), m_surface(0), m_depth(0), m_VAO(0), m_width(0), m_height(0) {}
+
+    // needs a current GL context
+    void init ()
+    {
+        glGenFramebuffers(1, &m_FBO);
+        glGenTextures(1, &m_albedo);
+        glGenTextures(1, &m_surface);
+        glGenTextures(1, &m_depth);
+        // the fullscreen triangle comes from gl_VertexID, core still wants a VAO bound
+        glGenVertexArrays(1, &m_VAO);
+    }
+
+    // register the DEFERRED variant of a forward mesh shader
+    void addVariant (const Shader & forwardShader, const Shader & gbufferShader)
+    {
+        m_variants[forwardShader.ID] = &gbufferShader;
+    }
+
+    const Shader & variant (const Shader & forwardShader) const
+    {
+        std::unordered_map<unsigned int, const Shader*>::const_iterator it = m_variants.find(forwardShader.ID);
+        return it != m_variants.end() ? *it->second : forwardShader;
+    }
+
+    // G-buffer memory at the current size
+    size_t bytes () const
+    {
+        return (size_t)m_width * m_height * (4 + 8 + 4);
+    }
+
+    // bind and clear the G-buffer, (re)allocated when the viewport size changed
+    void begin (int width, int height)
+    {
+        if (width != m_width || height != m_height)
+            allocate(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glViewport(0, 0, width, height);
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat far = 1.0f;
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_DEPTH, 0, &far);
+    }
+
+    void end ()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+    }
+
+    // light accumulation into the bound framebuffer; `shader` is deferred_fragment.glsl
+    // with its lighting uniforms already set, the scene depth is written back too
+    void resolve (const Shader & shader, const glm::mat4 & view, const glm::mat4 & projection) const
+    {
+        glActiveTexture(GL_TEXTURE0 + DEFERRED_FIRST_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_albedo);
+        glActiveTexture(GL_TEXTURE0 + DEFERRED_FIRST_UNIT + 1);
+        glBindTexture(GL_TEXTURE_2D, m_surface);
+        glActiveTexture(GL_TEXTURE0 + DEFERRED_FIRST_UNIT + 2);
+        glBindTexture(GL_TEXTURE_2D, m_depth);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.use();
+        shader.setInt("gAlbedo", DEFERRED_FIRST_UNIT);
+        shader.setInt("gSurface", DEFERRED_FIRST_UNIT + 1);
+        shader.setInt("gDepth", DEFERRED_FIRST_UNIT + 2);
+        shader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+
+        glDepthFunc(GL_ALWAYS);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glDepthFunc(GL_LESS);
+    }
+
+private:
+    unsigned int m_FBO, m_albedo, m_surface, m_depth, m_VAO;
+    int m_width, m_height;
+    std::unordered_map<unsigned int, const Shader*> m_variants;
+
+    static void target (unsigned int texture, GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        // read with texelFetch only, but a complete texture needs these
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void allocate (int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        target(m_albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        target(m_surface, GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, width, height);
+        target(m_depth, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_surface, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth, 0);
+        const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+    }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include <sys/stat.h>
+
+// GLSLs/ compiled into the binary: the Makefile runs embed_assets over the
+// directory into build/embedded_assets.hpp, names are relative to the repo root
+// ("GLSLs/lighting.glsl"). Startup reads no files and does not care about the
+// working directory. For development ASSET_DIR=<repo root> reads the files from
+// disk first, the embedded copy stays the fallback. Without it the hot reload still
+// watches GLSLs/ of the checkout, and an edited file is read from disk from then on
+// ------------------------------------------------------------------------------------
+
+struct EmbeddedAsset {
+    std::string_view name;
+    std::string_view data;
+};
+
+#include "embedded_assets.hpp"
+
+constexpr size_t EMBEDDED_ASSET_COUNT = sizeof(EMBEDDED_ASSETS) / sizeof(EMBEDDED_ASSETS[0]);
+
+// `directory + file` is an embedded name, without building the string
+constexpr bool isEmbedded (std::string_view directory, std::string_view file)
+{
+    for (size_t i = 0; i < EMBEDDED_ASSET_COUNT; ++i)
+    {
+        std::string_view name = EMBEDDED_ASSETS[i].name;
+        if (name.size() == directory.size() + file.size()
+            && name.substr(0, directory.size()) == directory && name.substr(directory.size()) == file)
+            return true;
+    }
+    return false;
+}
+
+// every `#include "file"` in one asset names another embedded asset, resolved
+// relative to the includer the way ShaderSource.hpp does it
+constexpr bool includesResolve (const EmbeddedAsset & asset)
+{
+    std::string_view directory = asset.name.substr(0, asset.name.find_last_of('/') + 1);
+    std::string_view code = asset.data;
+    size_t start = 0;
+    while (start < code.size())
+    {
+        size_t end = code.find('\n', start);
+        if (end == std::string_view::npos)
+            end = code.size();
+        std::string_view line = code.substr(start, end - start);
+        start = end + 1;
+
+        size_t hash = line.find_first_not_of(" \t");
+        if (hash == std::string_view::npos || line[hash] != '#')
+            continue;
+        size_t directive = line.find_first_not_of(" \t", hash + 1);
+        if (directive == std::string_view::npos || line.substr(directive, 7) != "include")
+            continue;
+        size_t open = line.find('"', directive), close = line.find('"', open + 1);
+        if (open == std::string_view::npos || close == std::string_view::npos
+            || !isEmbedded(directory, line.substr(open + 1, close - open - 1)))
+            return false;
+    }
+    return true;
+}
+
+constexpr bool embeddedIncludesResolve ()
+{
+    for (size_t i = 0; i < EMBEDDED_ASSET_COUNT; ++i)
+        if (!includesResolve(EMBEDDED_ASSETS[i]))
+            return false;
+    return true;
+}
+
+static_assert(embeddedIncludesResolve(), "an embedded shader #includes a file that is not in GLSLs/");
+
+// ASSET_DIR with a trailing slash, empty when unset
+inline const std::string & assetOverrideDir ()
+{
+    static const std::string directory = [] {
+        const char * value = getenv("ASSET_DIR");
+        std::string result = value ? value : "";
+        if (!result.empty() && result.back() != '/')
+            result += '/';
+        return result;
+    }();
+    return directory;
+}
+
+// where the asset files live on disk: ASSET_DIR, else the checkout the app is run
+// from (build/, so "../" when ../GLSLs/ is there), else empty
+inline const std::string & assetSourceDir ()
+{
+    static const std::string directory = [] {
+        if (!assetOverrideDir().empty())
+            return assetOverrideDir();
+        struct stat info;
+        return std::string(stat("../GLSLs", &info) == 0 && S_ISDIR(info.st_mode) ? "../" : "");
+    }();
+    return directory;
+}
+
+// names edited on disk since startup; they are read from assetSourceDir() from then on
+inline std::unordered_set<std::string> & editedAssets ()
+{
+    static std::unordered_set<std::string> names;
+    return names;
+}
+
+// the name of a file from its path on disk ("../GLSLs/x" -> "GLSLs/x")
+inline std::string assetName (const std::string & path)
+{
+    const std::string & directory = assetSourceDir();
+    if (!directory.empty() && path.compare(0, directory.size(), directory) == 0)
+        return path.substr(directory.size());
+    return path;
+}
+
+inline bool readAssetFile (const std::string & name, std::string & data)
+{
+    if (assetSourceDir().empty())
+        return false;
+    std::ifstream file((assetSourceDir() + name).c_str(), std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    data = stream.str();
+    return true;
+}
+
+// the file on disk with ASSET_DIR set or once it has been edited, else the embedded
+// copy; a file the binary does not have (a new #include) is read from disk too
+inline bool readAsset (const std::string & name, std::string & data)
+{
+    if ((!assetOverrideDir().empty() || editedAssets().count(name)) && readAssetFile(name, data))
+        return true;
+    for (const EmbeddedAsset & asset : EMBEDDED_ASSETS)
+        if (asset.name == name)
+        {
+            data.assign(asset.data.data(), asset.data.size());
+            return true;
+        }
+    return readAssetFile(name, data);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// inotify on a few flat directories, drained without blocking once per frame.
+// Editors either rewrite a file in place (close after write) or save a temporary
+// and rename it over the original (moved to), both count as a change
+// -------------------------------------------------------------------------------
+class FileWatcher {
+public:
+    FileWatcher ()
+        : m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    {
+        if (m_fd < 0)
+            std::cout << "WARNING::FILE_WATCHER::INOTIFY_UNAVAILABLE" << std::endl;
+    }
+
+    ~FileWatcher ()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    FileWatcher (const FileWatcher &) = delete;
+    FileWatcher & operator= (const FileWatcher &) = delete;
+
+    // directory with a trailing slash, reported paths are directory + file name
+    bool watch (const std::string & directory)
+    {
+        if (m_fd < 0)
+            return false;
+        int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            std::cout << "WARNING::FILE_WATCHER::CANNOT_WATCH " << directory << std::endl;
+            return false;
+        }
+        m_directories[wd] = directory;
+        return true;
+    }
+
+    // files changed since the last call, each once however many events it produced
+    std::vector<std::string> poll ()
+    {
+        std::vector<std::string> changed;
+        if (m_fd < 0)
+            return changed;
+
+        alignas(struct inotify_event) char buffer[4096];
+        for (;;)
+        {
+            ssize_t length = read(m_fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; // EAGAIN: nothing more queued
+            for (char * cursor = buffer; cursor < buffer + length; )
+            {
+                const struct inotify_event * event = (const struct inotify_event *)cursor;
+                cursor += sizeof(struct inotify_event) + event->len;
+                std::unordered_map<int, std::string>::const_iterator directory = m_directories.find(event->wd);
+                if (directory == m_directories.end() || event->len == 0)
+                    continue;
+                std::string path = directory->second + event->name;
+                if (std::find(changed.begin(), changed.end(), path) == changed.end())
+                    changed.push_back(path);
+            }
+        }
+        return changed;
+    }
+
+private:
+    int m_fd;
+    std::unordered_map<int, std::string> m_directories;
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cctype>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PNM.hpp"
+#include "RenderTarget.hpp"
+
+// records what is drawn into the default framebuffer, frame by frame, without the
+// render loop waiting on the read back or the disk. Each frame is read into the
+// next pixel buffer of a small ring behind a fence; a buffer is mapped once its
+// fence has passed, one or two frames later, and copied out for a writer thread
+// that converts it to RGB and writes it:
+//   "frame%05d.ppm"  an image sequence, the pattern gets the frame number
+//   "|command"       raw rgb24 frames, top row first, piped into e.g.
+//                    "|ffmpeg -f rawvideo -pix_fmt rgb24 -s 1920x1080 -r 60 -i - out.mp4"
+// When the writer falls behind, interactive capture drops frames (and counts them)
+// instead of slowing the loop down; blocking capture waits, for offline renders
+// --------------------------------------------------------------------------------
+
+// frames in flight on the GPU, and copied out waiting for the writer
+const int CAPTURE_RING = 3;
+const int CAPTURE_QUEUE = 4;
+
+// an image sequence pattern is handed to snprintf with the frame number: it needs
+// exactly one int conversion (%d, %i or %u, with 0 - + or space flags and a width
+// of up to two digits) and no other %
+inline bool validFramePattern (const std::string & pattern)
+{
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        if (pattern[i] != '%')
+            continue;
+        ++i;
+        while (i < pattern.size() && strchr("0-+ ", pattern[i]))
+            ++i;
+        for (int digits = 0; i < pattern.size() && isdigit((unsigned char)pattern[i]); ++digits, ++i)
+            if (digits == 2)
+                return false;
+        if (i == pattern.size() || !strchr("diu", pattern[i]))
+            return false;
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+class FrameCapture {
+public:
+    // since start(): frames read back, written out, dropped with the writer behind
+    unsigned int m_captured, m_written, m_dropped;
+    double m_readMs; // main thread time of the last capture()
+    bool m_blocking;
+
+    FrameCapture ()
+        : m_captured(0), m_written(0), m_dropped(0), m_readMs(0.0), m_blocking(false),
+          m_active(false), m_width(0), m_height(0), m_next(0), m_pipe(NULL), m_writtenCount(0), m_failed(false), m_quit(false)
+    {
+        for (int i = 0; i < CAPTURE_RING; ++i)
+        {
+            m_PBOs[i] = 0;
+            m_fences[i] = 0;
+            m_frameNumbers[i] = 0;
+        }
+    }
+
+    ~FrameCapture ()
+    {
+        stop();
+    }
+
+    bool active () const
+    {
+        return m_active;
+    }
+
+    // needs a current GL context; frames have to stay width x height until stop()
+    bool start (const std::string & target, int width, int height)
+    {
+        stop();
+        if (target.empty())
+            return false;
+        if (target[0] == '|')
+        {
+            // an encoder that quits early should not take the app down with it
+#if defined(SIGPIPE)
+            signal(SIGPIPE, SIG_IGN);
+#endif
+            m_pipe = popen(target.c_str() + 1, "w");
+            if (!m_pipe)
+            {
+                std::cout << "ERROR::CAPTURE::PIPE_FAILURE " << target << std::endl;
+                return false;
+            }
+        }
+        else if (!validFramePattern(target))
+        {
+            std::cout << "ERROR::CAPTURE::BAD_PATTERN " << target << " (needs one %d for the frame number)" << std::endl;
+            return false;
+        }
+        m_target = target;
+        m_width = width;
+        m_height = height;
+        m_captured = m_written = m_dropped = m_writtenCount = 0;
+        m_failed = m_quit = false;
+        m_next = 0;
+
+        size_t bytes = (size_t)width * height * 4;
+        glGenBuffers(CAPTURE_RING, m_PBOs);
+        for (int i = 0; i < CAPTURE_RING; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBOs[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_free.assign(CAPTURE_QUEUE, std::vector<unsigned char>(bytes));
+        m_writer = std::thread(&FrameCapture::writeLoop, this);
+        m_active = true;
+        return true;
+    }
+
+    // after the frame is drawn and before the swap
+    void capture (int width, int height)
+    {
+        if (!m_active)
+            return;
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_written = m_writtenCount;
+            failed = m_failed;
+        }
+        if (width != m_width || height != m_height || failed)
+        {
+            std::cout << "WARNING::CAPTURE::STOPPED " << (failed ? "write failed" : "framebuffer resized") << std::endl;
+            stop();
+            return;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+
+        // the ring is full: the oldest frame has had CAPTURE_RING - 1 frames to arrive
+        if (m_fences[m_next])
+            collect(m_next, true);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebuffer());
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBOs[m_next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        // BGRA is the layout framebuffers are usually stored in, a plain copy for the driver
+        glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, (void*)0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_fences[m_next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_frameNumbers[m_next] = m_captured++;
+        m_next = (m_next + 1) % CAPTURE_RING;
+
+        // hand over whatever has arrived since, oldest first
+        for (int i = 0; i < CAPTURE_RING - 1; ++i)
+        {
+            int slot = (m_next + i) % CAPTURE_RING;
+            if (m_fences[slot] && !collect(slot, false))
+                break;
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        m_readMs = elapsed.count();
+    }
+
+    // finishes the frames in flight and the writer, then releases everything
+    void stop ()
+    {
+        if (!m_active)
+            return;
+        for (int i = 0; i < CAPTURE_RING; ++i)
+        {
+            int slot = (m_next + i) % CAPTURE_RING;
+            if (m_fences[slot])
+                collect(slot, true);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_writer.join();
+        m_written = m_writtenCount;
+        if (m_pipe)
+            pclose(m_pipe);
+        m_pipe = NULL;
+        glDeleteBuffers(CAPTURE_RING, m_PBOs);
+        m_queue.clear();
+        m_free.clear();
+        m_active = false;
+        std::cout << "capture: " << m_written << " frames written, " << m_dropped << " dropped" << std::endl;
+    }
+
+private:
+    struct Frame {
+        unsigned int number;
+        std::vector<unsigned char> bgra;
+    };
+
+    bool m_active;
+    std::string m_target;
+    int m_width, m_height;
+    unsigned int m_PBOs[CAPTURE_RING];
+    GLsync m_fences[CAPTURE_RING];
+    unsigned int m_frameNumbers[CAPTURE_RING];
+    int m_next; // ring slot the next frame is read into
+    FILE * m_pipe;
+    unsigned int m_writtenCount; // the writer's side of m_written
+    bool m_failed;
+
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    std::deque<Frame> m_queue;                      // waiting for the writer
+    std::vector<std::vector<unsigned char>> m_free; // buffers to copy the next frames into
+    bool m_quit;
+
+    // copy one slot out for the writer; false if its fence has not passed and
+    // `wait` is off
+    bool collect (int slot, bool wait)
+    {
+        GLenum state = glClientWaitSync(m_fences[slot], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (state == GL_TIMEOUT_EXPIRED)
+            return false;
+        glDeleteSync(m_fences[slot]);
+        m_fences[slot] = 0;
+
+        std::vector<unsigned char> buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_free.empty() && m_blocking)
+                m_done.wait(lock, [this] { return !m_free.empty(); });
+            if (m_free.empty())
+            {
+                m_dropped++;
+                return true;
+            }
+            buffer.swap(m_free.back());
+            m_free.pop_back();
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBOs[slot]);
+        const void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, buffer.size(), GL_MAP_READ_BIT);
+        if (pixels)
+            memcpy(&buffer[0], pixels, buffer.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(Frame());
+        m_queue.back().number = m_frameNumbers[slot];
+        m_queue.back().bgra.swap(buffer);
+        m_wake.notify_one();
+        return true;
+    }
+
+    void writeLoop ()
+    {
+        std::vector<unsigned char> rgb((size_t)m_width * m_height * 3);
+        std::vector<char> path(m_target.size() + 32);
+        for (;;)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+                if (m_queue.empty())
+                    return;
+                frame.number = m_queue.front().number;
+                frame.bgra.swap(m_queue.front().bgra);
+                m_queue.pop_front();
+            }
+
+            size_t pixels = (size_t)m_width * m_height;
+            for (size_t i = 0; i < pixels; ++i)
+            {
+                rgb[3 * i + 0] = frame.bgra[4 * i + 2];
+                rgb[3 * i + 1] = frame.bgra[4 * i + 1];
+                rgb[3 * i + 2] = frame.bgra[4 * i + 0];
+            }
+            bool written = true;
+            if (m_pipe)
+            {
+                // GL rows are bottom first
+                size_t row = (size_t)m_width * 3;
+                for (int y = m_height - 1; y >= 0 && written; --y)
+                    written = fwrite(&rgb[y * row], 1, row, m_pipe) == row;
+            }
+            else
+            {
+                snprintf(&path[0], path.size(), m_target.c_str(), (int)frame.number);
+                written = savePPM(&path[0], m_width, m_height, &rgb[0]);
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (written)
+                m_writtenCount++;
+            else
+                m_failed = true;
+            m_free.push_back(std::vector<unsigned char>());
+            m_free.back().swap(frame.bgra);
+            m_done.notify_one();
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "LOD.hpp"
+#include "DeferredRenderer.hpp"
+#include "Impostors.hpp"
+#include "OcclusionQueries.hpp"
+#include "Procedural.hpp"
+#include "Shader.hpp"
+#include "TextureStreamer.hpp"
+
+// per frame state shared by every Node::draw call
+// -----------------------------------------------
+struct FrameContext {
+    glm::mat4 view;
+    glm::mat4 projection;
+    float viewportHeight;
+
+    // sphere tessellation levels built by buildSphereData
+    const std::vector<SphereLOD> * sphereLODs;
+    bool useSphereLOD;
+    LODStats lodStats;
+
+    // when set, spheres draw the level picked for the same instance by the pass
+    // before instead of picking again (the pass after the depth pre-pass, whose
+    // GL_EQUAL test needs the very same triangles)
+    bool reuseLOD;
+
+    // when set, sphere nodes are queued here instead of drawn as meshes
+    SphereImpostors * impostors;
+    unsigned int impostorCount;
+
+    // when set, nodes are drawn from gl_VertexID with the registered shader variants
+    const ProceduralPrimitives * procedural;
+
+    // Node::drawInstanced: the roots the subtree is drawn at, as uploaded with
+    // ProceduralPrimitives::setInstances, and the queryInstance of each
+    const std::vector<glm::mat4> * instances;
+    const std::vector<unsigned int> * instanceIds;
+
+    // resolves a textured node's handle to its layer and rect in the bound texture array
+    const TextureStreamer * textures;
+
+    // when set, mesh and procedural nodes draw with this program instead of their own (extra passes)
+    const Shader * shaderOverride;
+
+    // when set, lit nodes write the G-buffer through their DEFERRED variants
+    const DeferredRenderer * deferred;
+
+    // when set, mesh nodes bind positionVAOs[m_VAO] instead, the position-only
+    // stream of the same mesh (depth pre-pass)
+    const unsigned int * positionVAOs;
+
+    // when set, query-root subtrees are tested against it before drawing;
+    // queryInstance tells apart the draws of one subtree within a frame, for the
+    // queries and the per instance LOD hysteresis
+    OcclusionQueries * queries;
+    unsigned int queryInstance;
+
+    FrameContext ()
+        : view(glm::mat4(1.0f)),
+          projection(glm::mat4(1.0f)),
+          viewportHeight(1.0f),
+          sphereLODs(nullptr),
+          useSphereLOD(true),
+          reuseLOD(false),
+          impostors(nullptr),
+          impostorCount(0),
+          procedural(nullptr),
+          instances(nullptr),
+          instanceIds(nullptr),
+          textures(nullptr),
+          shaderOverride(nullptr),
+          deferred(nullptr),
+          positionVAOs(nullptr),
+          queries(nullptr),
+          queryInstance(0) {}
+
+    // call once per frame before the first Node::draw
+    void begin (const glm::mat4 & newView, const glm::mat4 & newProjection, float height)
+    {
+        view = newView;
+        projection = newProjection;
+        viewportHeight = height;
+        lodStats.reset();
+        impostorCount = 0;
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// query results read a few frames late from a small ring so nothing waits on the
+// GPU; only one query per target may be running at a time
+// --------------------------------------------------------------------------------
+
+const int GPU_QUERY_RING = 4;
+
+class GpuQuery {
+public:
+    // latest finished result
+    GLuint64 m_result;
+
+    explicit GpuQuery (GLenum target)
+        : m_result(0), m_target(target), m_issued(0), m_read(0)
+    {
+        for (int i = 0; i < GPU_QUERY_RING; ++i)
+            m_queries[i] = 0;
+    }
+
+    // needs a current GL context
+    void init ()
+    {
+        glGenQueries(GPU_QUERY_RING, m_queries);
+    }
+
+    void begin ()
+    {
+        // ring full: the oldest query has to be read before it is reused
+        if (m_issued - m_read >= (unsigned int)GPU_QUERY_RING)
+            read(true);
+        glBeginQuery(m_target, m_queries[m_issued % GPU_QUERY_RING]);
+    }
+
+    void end ()
+    {
+        glEndQuery(m_target);
+        m_issued++;
+        while (m_read < m_issued && read(false)) {}
+    }
+
+private:
+    GLenum m_target;
+    unsigned int m_queries[GPU_QUERY_RING];
+    unsigned int m_issued, m_read;
+
+    bool read (bool wait)
+    {
+        unsigned int query = m_queries[m_read % GPU_QUERY_RING];
+        GLint available = GL_TRUE;
+        if (!wait)
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &m_result);
+        m_read++;
+        return true;
+    }
+};
+
+// GPU time of a stretch of commands (GL_TIME_ELAPSED, core in 3.3)
+class GpuTimer : public GpuQuery {
+public:
+    GpuTimer ()
+        : GpuQuery(GL_TIME_ELAPSED) {}
+
+    double ms () const
+    {
+        return m_result / 1.0e6;
+    }
+};
+
+// samples passing the depth test, i.e. fragments shaded and written
+class SampleCounter : public GpuQuery {
+public:
+    SampleCounter ()
+        : GpuQuery(GL_SAMPLES_PASSED) {}
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// windowless OpenGL 3.3 core context for machines without a display server. Mesa's
+// surfaceless EGL platform gives one with no X, Wayland or GPU behind it (llvmpipe
+// renders), falling back to a small pbuffer on the default display elsewhere. There
+// is no window framebuffer either way: draw into a RenderTarget.
+// --------------------------------------------------------------------------------
+class HeadlessContext {
+public:
+    bool m_surfaceless; // no surface at all, otherwise a pbuffer is current
+
+    HeadlessContext ()
+        : m_surfaceless(false), m_start(std::chrono::steady_clock::now())
+#if defined(__linux__)
+          , m_display(EGL_NO_DISPLAY), m_context(EGL_NO_CONTEXT), m_surface(EGL_NO_SURFACE)
+#endif
+    {}
+
+    // loader for glad and the extension lookups, like glfwGetProcAddress
+    static void * procAddress (const char * name)
+    {
+#if defined(__linux__)
+        return (void *)eglGetProcAddress(name);
+#else
+        (void)name;
+        return nullptr;
+#endif
+    }
+
+    // seconds since the context was made, stands in for glfwGetTime
+    double time () const
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+        return elapsed.count();
+    }
+
+#if defined(__linux__)
+    // creates the context and makes it current
+    bool init ()
+    {
+        const char * clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (clientExtensions && getPlatformDisplay && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (m_display == EGL_NO_DISPLAY)
+            m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_DISPLAY_FAILURE" << std::endl;
+            return false;
+        }
+
+        // the colour and depth formats come from the RenderTarget, any GL config does
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglChooseConfig(m_display, configAttributes, &config, 1, &configs) || !configs)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CONFIG_FAILURE" << std::endl;
+            return false;
+        }
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (m_context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS::EGL_CONTEXT_FAILURE" << std::endl;
+            return false;
+        }
+
+        const char * extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+        m_surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+        if (!m_surfaceless)
+        {
+            const EGLint surfaceAttributes[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+            m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+        }
+        if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context))
+        {
+            std::cout << "ERROR::HEADLESS::EGL_MAKE_CURRENT_FAILURE" << std::endl;
+            return false;
+        }
+        m_start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void destroy ()
+    {
+        if (m_display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_surface != EGL_NO_SURFACE)
+            eglDestroySurface(m_display, m_surface);
+        if (m_context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+        m_display = EGL_NO_DISPLAY;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+    EGLDisplay m_display;
+    EGLContext m_context;
+    EGLSurface m_surface;
+#else
+    bool init ()
+    {
+        std::cout << "ERROR::HEADLESS::EGL_UNAVAILABLE" << std::endl;
+        return false;
+    }
+
+    void destroy () {}
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+#endif
+};
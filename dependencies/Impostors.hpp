@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Shader.hpp"
+#include "TextureArray.hpp"
+
+// one ray traced sphere: the node's scaled model matrix plus its color
+struct ImpostorInstance {
+    glm::mat4 model;
+    glm::vec4 color;       // rgb = objectColor, w = array layer + 1 for texture mapped nodes, 0 otherwise
+    glm::vec4 textureRect; // tile of the texture array, see TextureSlot
+};
+
+// collects sphere nodes during Node::draw and renders them as instanced quads
+// ---------------------------------------------------------------------------
+class SphereImpostors {
+public:
+    unsigned int m_VAO;
+    std::vector<ImpostorInstance> m_instances;
+
+    SphereImpostors ()
+        : m_VAO(0), m_quadVBO(0), m_instanceVBO(0), m_capacity(0) {}
+
+    // needs a current GL context
+    void init ()
+    {
+        float corners[] = {
+            -1.0f, -1.0f,
+             1.0f, -1.0f,
+            -1.0f,  1.0f,
+             1.0f,  1.0f
+        };
+
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_quadVBO);
+        glGenBuffers(1, &m_instanceVBO);
+
+        glBindVertexArray(m_VAO);
+        // quad corners
+        glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // per instance model matrix, one column per attribute
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)(i * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        // per instance color
+        glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)(4 * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(7);
+        glVertexAttribDivisor(7, 1);
+        // per instance texture tile
+        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)(5 * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(8);
+        glVertexAttribDivisor(8, 1);
+        glBindVertexArray(0);
+    }
+
+    void add (const glm::mat4 & model, const glm::vec3 & color, bool textured, const TextureSlot & slot)
+    {
+        ImpostorInstance instance;
+        instance.model = model;
+        instance.color = glm::vec4(color, textured ? slot.layer + 1.0f : 0.0f);
+        instance.textureRect = slot.rect;
+        m_instances.push_back(instance);
+    }
+
+    // draw everything collected since the last flush, textured instances sample the bound array
+    unsigned int flush (const Shader & shader)
+    {
+        unsigned int count = m_instances.size();
+        if (count == 0)
+            return 0;
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+        size_t bytes = count * sizeof(ImpostorInstance);
+        if (bytes > m_capacity)
+            m_capacity = bytes * 2;
+        // orphan the old storage so we never wait on last frame's draw
+        glBufferData(GL_ARRAY_BUFFER, m_capacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &m_instances[0]);
+
+        shader.use();
+        glBindVertexArray(m_VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+        m_instances.clear();
+        return count;
+    }
+
+private:
+    unsigned int m_quadVBO, m_instanceVBO;
+    size_t m_capacity;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// one tessellation level stored inside the shared sphere buffers
+// --------------------------------------------------------------
+struct SphereLOD {
+    unsigned int segments;   // X_SEGMENTS == Y_SEGMENTS for this level
+    unsigned int firstIndex; // offset into the element buffer (in indices)
+    unsigned int indexCount; // triangle strip length
+
+    unsigned int triangles () const
+    {
+        return indexCount - 2;
+    }
+};
+
+// tessellations generated by buildSphereData, finest first
+const unsigned int SPHERE_LOD_SEGMENTS[] = { 64, 32, 16, 8 };
+const unsigned int SPHERE_LOD_COUNT = sizeof(SPHERE_LOD_SEGMENTS) / sizeof(SPHERE_LOD_SEGMENTS[0]);
+
+// a level is used while the projected radius (in pixels) stays above its threshold
+const float SPHERE_LOD_THRESHOLDS[SPHERE_LOD_COUNT - 1] = { 120.0f, 48.0f, 16.0f };
+// relative band around every threshold that has to be crossed before switching
+const float SPHERE_LOD_HYSTERESIS = 0.15f;
+
+// per frame counters, reset before the scene is drawn
+// ---------------------------------------------------
+struct LODStats {
+    unsigned int draws[SPHERE_LOD_COUNT];
+    unsigned int triangles[SPHERE_LOD_COUNT];
+
+    LODStats () { reset(); }
+
+    void reset ()
+    {
+        for (unsigned int i = 0; i < SPHERE_LOD_COUNT; ++i)
+            draws[i] = triangles[i] = 0;
+    }
+
+    void record (unsigned int level, unsigned int triangleCount)
+    {
+        draws[level]++;
+        triangles[level] += triangleCount;
+    }
+};
+
+// projected radius in pixels of a unit-diameter sphere transformed by model
+// -------------------------------------------------------------------------
+inline float projectedSphereRadius (const glm::mat4 & model, const glm::mat4 & view, const glm::mat4 & projection, float viewportHeight)
+{
+    // buildSphereData generates spheres of radius 0.5, the scale lives in the model matrix
+    float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    float radius = 0.5f * scale;
+    glm::vec4 center = view * model[3];
+    float distance = -center.z;
+    // camera inside (or behind) the sphere: always use the finest level
+    if (distance <= radius)
+        return viewportHeight;
+    return radius * projection[1][1] * 0.5f * viewportHeight / distance;
+}
+
+// level for a projected radius with every threshold scaled by `bias`
+// ------------------------------------------------------------------
+inline unsigned int sphereLODForRadius (float pixelRadius, float bias)
+{
+    unsigned int level = 0;
+    while (level < SPHERE_LOD_COUNT - 1 && pixelRadius < SPHERE_LOD_THRESHOLDS[level] * bias)
+        ++level;
+    return level;
+}
+
+// choose a level from the projected radius, staying on `current` inside the hysteresis band
+// -----------------------------------------------------------------------------------------
+inline unsigned int selectSphereLOD (float pixelRadius, int current)
+{
+    if (current < 0)
+        return sphereLODForRadius(pixelRadius, 1.0f);
+
+    // going coarser needs the radius clearly below a threshold, going finer clearly above
+    unsigned int coarser = sphereLODForRadius(pixelRadius, 1.0f - SPHERE_LOD_HYSTERESIS);
+    unsigned int finer = sphereLODForRadius(pixelRadius, 1.0f + SPHERE_LOD_HYSTERESIS);
+    if (coarser > (unsigned int)current)
+        return coarser;
+    if (finer < (unsigned int)current)
+        return finer;
+    return current;
+}
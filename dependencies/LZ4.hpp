@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// LZ4 block format (no frame header), enough for AssetArchive entries: a greedy
+// single-probe compressor and a bounds-checked decoder. Sequences are a token
+// (literal length << 4 | match length - 4), the literals, a 16 bit little endian
+// offset; the last 5 bytes are always literals and no match starts in the last 12
+// ---------------------------------------------------------------------------------
+
+const int LZ4_MIN_MATCH = 4;
+const int LZ4_HASH_BITS = 16;
+
+inline uint32_t lz4Read32 (const unsigned char * p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+inline uint32_t lz4Hash (uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// 15 in the token nibble, then bytes of 255 and the remainder
+inline void lz4WriteLength (std::vector<unsigned char> & out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((unsigned char)length);
+}
+
+inline void lz4WriteSequence (std::vector<unsigned char> & out, const unsigned char * literals, size_t literalLength,
+                              size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - LZ4_MIN_MATCH : 0;
+    out.push_back((unsigned char)((literalLength < 15 ? literalLength : 15) << 4 | (matchCode < 15 ? matchCode : 15)));
+    if (literalLength >= 15)
+        lz4WriteLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+    if (!matchLength)
+        return; // the last sequence has no match
+    out.push_back((unsigned char)(offset & 0xff));
+    out.push_back((unsigned char)(offset >> 8));
+    if (matchCode >= 15)
+        lz4WriteLength(out, matchCode - 15);
+}
+
+inline void lz4Compress (const unsigned char * source, size_t size, std::vector<unsigned char> & out)
+{
+    out.clear();
+    std::vector<uint32_t> table(1 << LZ4_HASH_BITS, 0); // position + 1, 0 for empty
+    size_t anchor = 0, position = 0;
+    const size_t matchLimit = size > 12 ? size - 12 : 0, copyLimit = size > 5 ? size - 5 : 0;
+    while (position < matchLimit)
+    {
+        uint32_t sequence = lz4Read32(source + position);
+        uint32_t & slot = table[lz4Hash(sequence)];
+        size_t candidate = slot;
+        slot = position + 1;
+        if (!candidate || position - (candidate - 1) > 65535 || lz4Read32(source + candidate - 1) != sequence)
+        {
+            position++;
+            continue;
+        }
+        candidate--;
+        size_t length = LZ4_MIN_MATCH;
+        while (position + length < copyLimit && source[candidate + length] == source[position + length])
+            length++;
+        lz4WriteSequence(out, source + anchor, position - anchor, position - candidate, length);
+        position += length;
+        anchor = position;
+    }
+    lz4WriteSequence(out, source + anchor, size - anchor, 0, 0);
+}
+
+// false on anything malformed instead of reading or writing out of bounds
+inline bool lz4Decompress (const unsigned char * source, size_t size, unsigned char * out, size_t outSize)
+{
+    const unsigned char * in = source, * end = source + size;
+    size_t written = 0;
+    while (in < end)
+    {
+        unsigned char token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            unsigned char byte;
+            do
+            {
+                if (in >= end)
+                    return false;
+                byte = *in++;
+                literals += byte;
+            } while (byte == 255);
+        }
+        if (literals > (size_t)(end - in) || literals > outSize - written)
+            return false;
+        memcpy(out + written, in, literals);
+        in += literals;
+        written += literals;
+        if (in == end)
+            break; // last sequence
+
+        if (end - in < 2)
+            return false;
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15)
+        {
+            unsigned char byte;
+            do
+            {
+                if (in >= end)
+                    return false;
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > written || length > outSize - written)
+            return false;
+        // byte by byte only when the match overlaps what it is copying
+        if (offset >= length)
+            memcpy(out + written, out + written - offset, length);
+        else
+            for (size_t i = 0; i < length; ++i)
+                out[written + i] = out[written + i - offset];
+        written += length;
+    }
+    return written == outSize;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// read-only mmap of a whole file, unmapped when destroyed
+// -------------------------------------------------------
+class MappedFile {
+public:
+    MappedFile ()
+        : m_data(NULL), m_size(0) {}
+
+    explicit MappedFile (const char * path)
+        : m_data(NULL), m_size(0)
+    {
+        open(path);
+    }
+
+    MappedFile (MappedFile && other)
+        : m_data(other.m_data), m_size(other.m_size)
+    {
+        other.m_data = NULL;
+        other.m_size = 0;
+    }
+
+    MappedFile & operator= (MappedFile && other)
+    {
+        if (this != &other)
+        {
+            close();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = NULL;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    MappedFile (const MappedFile &) = delete;
+    MappedFile & operator= (const MappedFile &) = delete;
+
+    ~MappedFile ()
+    {
+        close();
+    }
+
+    bool open (const char * path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = (const unsigned char *)data;
+                m_size = info.st_size;
+            }
+        }
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        return m_data != NULL;
+    }
+
+    void close ()
+    {
+        if (m_data)
+            munmap((void*)m_data, m_size);
+        m_data = NULL;
+        m_size = 0;
+    }
+
+    bool valid () const { return m_data != NULL; }
+    const unsigned char * data () const { return m_data; }
+    size_t size () const { return m_size; }
+
+private:
+    const unsigned char * m_data;
+    size_t m_size;
+};
+
+// FNV-1a, good enough to notice an edited source file; pass a previous hash as
+// the seed to extend it
+inline uint64_t hashBytes (const unsigned char * data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// CPU mip chain generation: every level is filtered in linear light from the
+// previous linear level (so rounding never accumulates), then encoded back to
+// sRGB 8 bit. Pixels are processed as float4 so one SSE register holds one texel,
+// and rows of every level are split across threads.
+// ------------------------------------------------------------------------------
+
+enum MipFilter {
+    MIP_BOX,    // 2x2 average
+    MIP_KAISER  // 6 tap Kaiser windowed sinc, sharper minification
+};
+
+struct MipOptions {
+    MipFilter filter;
+    bool srgb;            // color channels are sRGB encoded (alpha is always linear)
+    unsigned int threads; // 0 = hardware concurrency
+
+    MipOptions ()
+        : filter(MIP_BOX), srgb(true), threads(0) {}
+};
+
+// one output level: tightly packed 8 bit pixels
+struct MipLevelData {
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+// run work(begin, end) over [0, rows) on up to `threads` threads
+template <typename F>
+void parallelRows (int rows, unsigned int threads, F work)
+{
+    // small levels are not worth a thread start
+    unsigned int count = std::max(1u, std::min(threads, (unsigned int)(rows / 16)));
+    if (count == 1)
+    {
+        work(0, rows);
+        return;
+    }
+    std::vector<std::thread> workers;
+    int step = (rows + count - 1) / count;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        int begin = i * step, end = std::min(rows, begin + step);
+        if (begin < end)
+            workers.push_back(std::thread(work, begin, end));
+    }
+    for (std::thread & worker : workers)
+        worker.join();
+}
+
+// sRGB <-> linear tables, built once
+// ----------------------------------
+const int LINEAR_TO_SRGB_SIZE = 8192;
+
+struct SrgbTables {
+    float toLinear[256];
+    unsigned char toSrgb[LINEAR_TO_SRGB_SIZE];
+
+    SrgbTables ()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < LINEAR_TO_SRGB_SIZE; ++i)
+        {
+            float l = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (unsigned char)std::min(255.0f, c * 255.0f + 0.5f);
+        }
+    }
+
+    static const SrgbTables & get ()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+};
+
+// 8 bit pixels -> float4 linear (missing channels become 0, missing alpha 1)
+inline void decodeLinear (const unsigned char * pixels, int width, int height, int channels, bool srgb, std::vector<float> & out, unsigned int threads)
+{
+    const SrgbTables & tables = SrgbTables::get();
+    out.resize((size_t)width * height * 4);
+    int colorChannels = channels == 4 ? 3 : channels;
+    parallelRows(height, threads, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                const unsigned char * src = pixels + ((size_t)y * width + x) * channels;
+                float * dst = &out[((size_t)y * width + x) * 4];
+                dst[0] = dst[1] = dst[2] = 0.0f;
+                dst[3] = 1.0f;
+                for (int c = 0; c < colorChannels; ++c)
+                    dst[c] = srgb ? tables.toLinear[src[c]] : src[c] / 255.0f;
+                if (channels == 4)
+                    dst[3] = src[3] / 255.0f;
+            }
+    });
+}
+
+// float4 linear -> 8 bit pixels with `channels` channels
+inline void encodeLinear (const std::vector<float> & linear, int width, int height, int channels, bool srgb, std::vector<unsigned char> & out, unsigned int threads)
+{
+    const SrgbTables & tables = SrgbTables::get();
+    out.resize((size_t)width * height * channels);
+    int colorChannels = channels == 4 ? 3 : channels;
+    parallelRows(height, threads, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                const float * src = &linear[((size_t)y * width + x) * 4];
+                unsigned char * dst = &out[((size_t)y * width + x) * channels];
+                for (int c = 0; c < colorChannels; ++c)
+                {
+                    float v = std::min(1.0f, std::max(0.0f, src[c]));
+                    dst[c] = srgb ? tables.toSrgb[(int)(v * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)] : (unsigned char)(v * 255.0f + 0.5f);
+                }
+                if (channels == 4)
+                    dst[3] = (unsigned char)(std::min(1.0f, std::max(0.0f, src[3])) * 255.0f + 0.5f);
+            }
+    });
+}
+
+// 2x2 box, edge texels are clamped for odd sizes
+inline void downsampleBox (const std::vector<float> & src, int width, int height, std::vector<float> & dst, int dstWidth, int dstHeight, unsigned int threads)
+{
+    dst.resize((size_t)dstWidth * dstHeight * 4);
+    parallelRows(dstHeight, threads, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            const float * row0 = &src[(size_t)std::min(2 * y, height - 1) * width * 4];
+            const float * row1 = &src[(size_t)std::min(2 * y + 1, height - 1) * width * 4];
+            float * out = &dst[(size_t)y * dstWidth * 4];
+            for (int x = 0; x < dstWidth; ++x)
+            {
+                int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+#if defined(__SSE2__)
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                        _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                for (int c = 0; c < 4; ++c)
+                    out[x * 4 + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+#endif
+            }
+        }
+    });
+}
+
+// 6 tap weights of a Kaiser windowed sinc for 2:1 reduction, normalised
+struct KaiserKernel {
+    static const int TAPS = 6;
+    float weights[TAPS];
+
+    KaiserKernel ()
+    {
+        const float alpha = 4.0f;
+        const float halfWidth = 1.5f; // in destination texels
+        float sum = 0.0f;
+        for (int i = 0; i < TAPS; ++i)
+        {
+            // source texel centers relative to the destination center, in destination texels
+            float x = (i - 2.5f) * 0.5f;
+            float sinc = std::fabs(x) < 1e-6f ? 1.0f : std::sin(M_PI * x) / (M_PI * x);
+            float t = x / halfWidth;
+            float window = besselI0(alpha * std::sqrt(std::max(0.0f, 1.0f - t * t))) / besselI0(alpha);
+            weights[i] = sinc * window;
+            sum += weights[i];
+        }
+        for (int i = 0; i < TAPS; ++i)
+            weights[i] /= sum;
+    }
+
+    static float besselI0 (float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 20; ++k)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static const KaiserKernel & get ()
+    {
+        static const KaiserKernel kernel;
+        return kernel;
+    }
+};
+
+// separable Kaiser: horizontal pass into a half width buffer, then vertical
+inline void downsampleKaiser (const std::vector<float> & src, int width, int height, std::vector<float> & dst, int dstWidth, int dstHeight, unsigned int threads)
+{
+    const KaiserKernel & kernel = KaiserKernel::get();
+    std::vector<float> horizontal((size_t)dstWidth * height * 4);
+    dst.resize((size_t)dstWidth * dstHeight * 4);
+
+    parallelRows(height, threads, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            const float * row = &src[(size_t)y * width * 4];
+            float * out = &horizontal[(size_t)y * dstWidth * 4];
+            for (int x = 0; x < dstWidth; ++x)
+            {
+#if defined(__SSE2__)
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KaiserKernel::TAPS; ++i)
+                {
+                    int sx = std::min(std::max(2 * x - 2 + i, 0), width - 1);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), _mm_set1_ps(kernel.weights[i])));
+                }
+                _mm_storeu_ps(out + x * 4, sum);
+#else
+                for (int c = 0; c < 4; ++c)
+                {
+                    float sum = 0.0f;
+                    for (int i = 0; i < KaiserKernel::TAPS; ++i)
+                        sum += row[std::min(std::max(2 * x - 2 + i, 0), width - 1) * 4 + c] * kernel.weights[i];
+                    out[x * 4 + c] = sum;
+                }
+#endif
+            }
+        }
+    });
+
+    parallelRows(dstHeight, threads, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            float * out = &dst[(size_t)y * dstWidth * 4];
+            const float * rows[KaiserKernel::TAPS];
+            for (int i = 0; i < KaiserKernel::TAPS; ++i)
+                rows[i] = &horizontal[(size_t)std::min(std::max(2 * y - 2 + i, 0), height - 1) * dstWidth * 4];
+            for (int x = 0; x < dstWidth; ++x)
+            {
+#if defined(__SSE2__)
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < KaiserKernel::TAPS; ++i)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[i] + x * 4), _mm_set1_ps(kernel.weights[i])));
+                _mm_storeu_ps(out + x * 4, sum);
+#else
+                for (int c = 0; c < 4; ++c)
+                {
+                    float sum = 0.0f;
+                    for (int i = 0; i < KaiserKernel::TAPS; ++i)
+                        sum += rows[i][x * 4 + c] * kernel.weights[i];
+                    out[x * 4 + c] = sum;
+                }
+#endif
+            }
+        }
+    });
+}
+
+// every level below the base image, down to 1x1
+// ---------------------------------------------
+inline void generateMips (const unsigned char * pixels, int width, int height, int channels, const MipOptions & options, std::vector<MipLevelData> & levels)
+{
+    unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> current, next;
+    decodeLinear(pixels, width, height, channels, options.srgb, current, threads);
+
+    levels.clear();
+    while (width > 1 || height > 1)
+    {
+        int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+        if (options.filter == MIP_KAISER)
+            downsampleKaiser(current, width, height, next, nextWidth, nextHeight, threads);
+        else
+            downsampleBox(current, width, height, next, nextWidth, nextHeight, threads);
+
+        MipLevelData level;
+        level.width = nextWidth;
+        level.height = nextHeight;
+        encodeLinear(next, nextWidth, nextHeight, channels, options.srgb, level.pixels, threads);
+        levels.push_back(std::move(level));
+
+        current.swap(next);
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
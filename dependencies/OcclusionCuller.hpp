@@ -0,0 +1,446 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// SSE2, always there on x86-64
+#include <emmintrin.h>
+
+#include "LOD.hpp"
+#include "WorkerPool.hpp"
+
+// CPU occlusion culling: a few designated occluders are rasterised into a small
+// depth buffer every frame, then bounding spheres are tested against it before
+// their nodes are submitted. Four pixels go through the edge functions at once
+// and the lane mask decides which of them take the depth; rows are split into
+// bands across the worker pool for the raster and the queries are split likewise.
+// The raster is conservative: a pixel takes an occluder only when the occluder's
+// outline covers all of it, and then the farthest depth of the front faces over
+// it. With occluder meshes that lie inside what they stand for (a tessellated
+// sphere does) a query is never culled by depth that is not really there
+// -------------------------------------------------------------------------------
+
+const int OCCLUSION_WIDTH = 320;  // multiple of 4, one SSE register per step
+const int OCCLUSION_HEIGHT = 184;
+const int OCCLUSION_BAND = 8;     // rows per unit of threaded work
+
+// a closed triangle mesh in object space, wound counter-clockwise seen from outside
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    // per triangle edge (ab, bc, ca): the triangle on the other side
+    std::vector<int> neighbours;
+};
+
+// winds every triangle outwards (occluders are shapes around their origin) and
+// links each edge to the triangle sharing it
+inline void buildOccluderTopology (OccluderMesh & mesh)
+{
+    std::map<std::pair<unsigned int, unsigned int>, int> edges;
+    mesh.neighbours.assign(mesh.indices.size(), -1);
+    for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const glm::vec3 & a = mesh.positions[mesh.indices[i]], & b = mesh.positions[mesh.indices[i + 1]], & c = mesh.positions[mesh.indices[i + 2]];
+        if (glm::dot(glm::cross(b - a, c - a), a + b + c) < 0.0f)
+            std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+        for (int e = 0; e < 3; ++e)
+        {
+            unsigned int from = mesh.indices[i + e], to = mesh.indices[i + (e + 1) % 3];
+            std::pair<unsigned int, unsigned int> key(std::min(from, to), std::max(from, to));
+            std::map<std::pair<unsigned int, unsigned int>, int>::iterator other = edges.find(key);
+            if (other == edges.end())
+                edges[key] = i + e;
+            else
+            {
+                mesh.neighbours[i + e] = other->second / 3;
+                mesh.neighbours[other->second] = i / 3;
+            }
+        }
+    }
+}
+
+// one tessellation level of the buildSphereData buffers (triangle strip, 8 floats per vertex)
+inline OccluderMesh occluderFromSphere (const std::vector<float> & vertices, const std::vector<unsigned int> & strip, const SphereLOD & lod)
+{
+    // the seam and the poles repeat positions, welded so the surface is closed
+    OccluderMesh mesh;
+    std::map<std::tuple<int, int, int>, unsigned int> welded;
+    std::map<unsigned int, unsigned int> remap;
+    auto weld = [&](unsigned int index) {
+        std::map<unsigned int, unsigned int>::iterator known = remap.find(index);
+        if (known != remap.end())
+            return known->second;
+        glm::vec3 position(vertices[index * 8], vertices[index * 8 + 1], vertices[index * 8 + 2]);
+        std::tuple<int, int, int> key((int)std::lround(position.x * 1e4f), (int)std::lround(position.y * 1e4f), (int)std::lround(position.z * 1e4f));
+        std::map<std::tuple<int, int, int>, unsigned int>::iterator it = welded.find(key);
+        if (it == welded.end())
+        {
+            it = welded.emplace(key, mesh.positions.size()).first;
+            mesh.positions.push_back(position);
+        }
+        return remap[index] = it->second;
+    };
+    // the level's grid starts at its first strip index, rows of segments + 1 vertices
+    unsigned int base = strip[lod.firstIndex], columns = lod.segments + 1;
+    for (unsigned int i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; ++i)
+    {
+        // the turns between rows make slivers down the seam, only halves of a grid
+        // cell are surface
+        unsigned int rows[3], cols[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            rows[k] = (strip[i + k] - base) / columns;
+            cols[k] = (strip[i + k] - base) % columns;
+        }
+        if (*std::max_element(rows, rows + 3) - *std::min_element(rows, rows + 3) != 1
+            || *std::max_element(cols, cols + 3) - *std::min_element(cols, cols + 3) != 1)
+            continue;
+        unsigned int a = weld(strip[i]), b = weld(strip[i + 1]), c = weld(strip[i + 2]);
+        // triangles at the poles collapse
+        if (a != b && b != c && a != c)
+            mesh.indices.insert(mesh.indices.end(), { a, b, c });
+    }
+    buildOccluderTopology(mesh);
+    return mesh;
+}
+
+// the unit cube of buildCubeData
+inline OccluderMesh occluderBox ()
+{
+    OccluderMesh mesh;
+    for (int i = 0; i < 8; ++i)
+        mesh.positions.push_back(glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f));
+    mesh.indices = { 0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5,  0, 4, 5, 0, 5, 1,
+                     2, 3, 7, 2, 7, 6,  0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3 };
+    buildOccluderTopology(mesh);
+    return mesh;
+}
+
+class OcclusionCuller {
+public:
+    // last frame: queries, culled by depth, outside the view (beside it or past the far
+    // plane), occluder front faces rasterised, cost and threads
+    unsigned int m_tested, m_culled, m_outside, m_triangles, m_threads;
+    double m_rasterMs, m_testMs;
+
+    OcclusionCuller ()
+        : m_tested(0), m_culled(0), m_outside(0), m_triangles(0), m_threads(1), m_rasterMs(0.0), m_testMs(0.0),
+          m_depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f) {}
+
+    // start a frame: clears the occluders, keeps the depth buffer until render()
+    void begin (const glm::mat4 & view, const glm::mat4 & projection, float near)
+    {
+        m_view = view;
+        m_projection = projection;
+        m_viewProjection = projection * view;
+        m_near = near;
+        m_screen.clear();
+        m_outline.clear();
+        m_occluders.clear();
+        m_triangles = 0;
+    }
+
+    // a designated occluder: its front faces, and the edges where they meet back
+    // faces or triangles reaching behind the near plane (dropped, which only ever
+    // makes the occluder smaller) as its outline
+    void addOccluder (const OccluderMesh & mesh, const glm::mat4 & model)
+    {
+        glm::mat4 transform = m_viewProjection * model;
+        std::vector<glm::vec4> projected(mesh.positions.size());
+        for (unsigned int i = 0; i < mesh.positions.size(); ++i)
+        {
+            glm::vec4 clip = transform * glm::vec4(mesh.positions[i], 1.0f);
+            if (clip.w < m_near)
+            {
+                projected[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+                continue;
+            }
+            // pixel position and window depth
+            projected[i] = glm::vec4((clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+                                     (clip.y / clip.w * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                                     clip.z / clip.w * 0.5f + 0.5f, 1.0f);
+        }
+
+        unsigned int triangleCount = mesh.indices.size() / 3;
+        std::vector<unsigned char> front(triangleCount);
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            const glm::vec4 & a = projected[mesh.indices[3 * t]], & b = projected[mesh.indices[3 * t + 1]], & c = projected[mesh.indices[3 * t + 2]];
+            front[t] = a.w > 0.0f && b.w > 0.0f && c.w > 0.0f && (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y) > 1e-6f;
+        }
+
+        ScreenOccluder occluder;
+        occluder.firstTriangle = m_screen.size();
+        occluder.firstEdge = m_outline.size();
+        glm::vec2 low(OCCLUSION_WIDTH, OCCLUSION_HEIGHT), high(0.0f);
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            if (!front[t])
+                continue;
+            for (int e = 0; e < 3; ++e)
+            {
+                const glm::vec4 & v = projected[mesh.indices[3 * t + e]];
+                m_screen.push_back(glm::vec3(v));
+                low = glm::min(low, glm::vec2(v));
+                high = glm::max(high, glm::vec2(v));
+                int neighbour = mesh.neighbours[3 * t + e];
+                if (neighbour < 0 || !front[neighbour])
+                {
+                    m_outline.push_back(glm::vec2(v));
+                    m_outline.push_back(glm::vec2(projected[mesh.indices[3 * t + (e + 1) % 3]]));
+                }
+            }
+            m_triangles++;
+        }
+        occluder.triangleCount = (m_screen.size() - occluder.firstTriangle) / 3;
+        occluder.edgeCount = (m_outline.size() - occluder.firstEdge) / 2;
+        // pixels touching the screen box of the front faces
+        occluder.minX = std::max(0, (int)floor(low.x));
+        occluder.maxX = std::min(OCCLUSION_WIDTH - 1, (int)floor(high.x));
+        occluder.minY = std::max(0, (int)floor(low.y));
+        occluder.maxY = std::min(OCCLUSION_HEIGHT - 1, (int)floor(high.y));
+        if (occluder.triangleCount && occluder.minX <= occluder.maxX && occluder.minY <= occluder.maxY)
+            m_occluders.push_back(occluder);
+    }
+
+    // rasterise every occluder added since begin()
+    void render ()
+    {
+        auto start = std::chrono::steady_clock::now();
+        const int bands = OCCLUSION_HEIGHT / OCCLUSION_BAND;
+        m_threads = m_triangles < 256 ? 1 : std::min(workerPool().size(), (unsigned int)bands);
+        workerPool().run(bands, [this](int band) { rasterBand(band * OCCLUSION_BAND, (band + 1) * OCCLUSION_BAND); }, m_threads);
+        m_rasterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // world space bounding spheres (xyz center, w radius) to one flag each, 0 when hidden
+    void test (const std::vector<glm::vec4> & spheres, std::vector<unsigned char> & visible)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_results.assign(spheres.size(), QUERY_VISIBLE);
+        const int chunk = 64;
+        int chunks = (spheres.size() + chunk - 1) / chunk;
+        workerPool().run(chunks, [&](int c) {
+            for (unsigned int i = c * chunk; i < std::min(spheres.size(), (size_t)(c + 1) * chunk); ++i)
+                m_results[i] = query(spheres[i]);
+        }, m_threads);
+        visible.resize(spheres.size());
+        for (unsigned int i = 0; i < spheres.size(); ++i)
+            visible[i] = m_results[i] == QUERY_VISIBLE;
+        m_tested = spheres.size();
+        m_culled = std::count(m_results.begin(), m_results.end(), QUERY_OCCLUDED);
+        m_outside = std::count(m_results.begin(), m_results.end(), QUERY_OUTSIDE);
+        m_testMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    enum QueryResult : unsigned char {
+        QUERY_OCCLUDED,
+        QUERY_VISIBLE,
+        QUERY_OUTSIDE
+    };
+
+    // an occluder as added this frame: ranges of m_screen and m_outline, pixel box
+    struct ScreenOccluder {
+        unsigned int firstTriangle, triangleCount, firstEdge, edgeCount;
+        int minX, maxX, minY, maxY;
+    };
+
+    glm::mat4 m_view, m_projection, m_viewProjection;
+    float m_near;
+    std::vector<glm::vec3> m_screen;  // front faces: pixel x, y and window depth
+    std::vector<glm::vec2> m_outline; // outline edges, pixel x and y of both ends
+    std::vector<ScreenOccluder> m_occluders;
+    std::vector<float> m_depth;       // per pixel, row major: occluded everywhere behind this depth
+    std::vector<unsigned char> m_results;
+
+    // every occluder on its own into band-local buffers: the farthest front face
+    // depth over each pixel a face touches, and a mask of the pixels the outline
+    // crosses. Touched pixels the outline does not cross lie wholly inside the
+    // occluder and take its depth
+    void rasterBand (int rowBegin, int rowEnd)
+    {
+        for (int y = rowBegin; y < rowEnd; ++y)
+            std::fill(m_depth.begin() + y * OCCLUSION_WIDTH, m_depth.begin() + (y + 1) * OCCLUSION_WIDTH, 1.0f);
+
+        alignas(16) float farthest[OCCLUSION_BAND * OCCLUSION_WIDTH];
+        alignas(16) float crossed[OCCLUSION_BAND * OCCLUSION_WIDTH]; // all bits set where the outline passes
+        const float untouched = -std::numeric_limits<float>::max();
+        for (const ScreenOccluder & occluder : m_occluders)
+        {
+            int minY = std::max(rowBegin, occluder.minY), maxY = std::min(rowEnd - 1, occluder.maxY);
+            // whole SSE groups, the lanes past the box stay untouched
+            int minX = occluder.minX & ~3, maxX = occluder.maxX | 3;
+            if (minY > maxY)
+                continue;
+            for (int y = minY; y <= maxY; ++y)
+            {
+                std::fill(farthest + (y - rowBegin) * OCCLUSION_WIDTH + minX, farthest + (y - rowBegin) * OCCLUSION_WIDTH + maxX + 1, untouched);
+                std::fill(crossed + (y - rowBegin) * OCCLUSION_WIDTH + minX, crossed + (y - rowBegin) * OCCLUSION_WIDTH + maxX + 1, 0.0f);
+            }
+            for (unsigned int t = 0; t < occluder.triangleCount; ++t)
+                rasterFace(&m_screen[3 * (occluder.firstTriangle + t)], rowBegin, minY, maxY, farthest);
+            for (unsigned int e = 0; e < occluder.edgeCount; ++e)
+                rasterOutline(&m_outline[2 * (occluder.firstEdge + e)], rowBegin, minY, maxY, crossed);
+
+            // masked store: only covered lanes take the nearer depth
+            const __m128 none = _mm_set1_ps(untouched);
+            for (int y = minY; y <= maxY; ++y)
+            {
+                float * row = &m_depth[y * OCCLUSION_WIDTH];
+                const float * far = farthest + (y - rowBegin) * OCCLUSION_WIDTH, * cross = crossed + (y - rowBegin) * OCCLUSION_WIDTH;
+                for (int x = minX; x <= maxX; x += 4)
+                {
+                    __m128 depth = _mm_load_ps(far + x);
+                    __m128 covered = _mm_andnot_ps(_mm_load_ps(cross + x), _mm_cmpgt_ps(depth, none));
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(current, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearer), _mm_andnot_ps(covered, current)));
+                }
+            }
+        }
+    }
+
+    // lanes x .. x + 3 that lie in [minX, maxX]
+    static __m128 laneRange (int x, int minX, int maxX)
+    {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        return _mm_and_ps(_mm_cmpge_ps(px, _mm_set1_ps((float)minX)), _mm_cmple_ps(px, _mm_set1_ps((float)maxX)));
+    }
+
+    // raise `farthest` to the face's depth plane at its farthest over each pixel the
+    // face touches; a pixel square and the triangle overlap when their boxes do
+    // and the square reaches into all three edges' inner half planes
+    void rasterFace (const glm::vec3 * vertices, int rowBegin, int rowMin, int rowMax, float * farthest)
+    {
+        const glm::vec3 & v0 = vertices[0], & v1 = vertices[1], & v2 = vertices[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        int minY = std::max(rowMin, (int)floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        int maxY = std::min(rowMax, (int)floor(std::max(v0.y, std::max(v1.y, v2.y))));
+        int minX = std::max(0, (int)floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        int maxX = std::min(OCCLUSION_WIDTH - 1, (int)floor(std::max(v0.x, std::max(v1.x, v2.x))));
+        if (minY > maxY || minX > maxX)
+            return;
+
+        // edge i: a * x + b * y + c, the edge opposite vertex i, positive inside (front
+        // faces are counter-clockwise); plus `slack` at a pixel center it is the value
+        // at the pixel's most inside corner
+        const glm::vec3 * corners[3] = { &v1, &v2, &v0 };
+        const glm::vec3 * ends[3] = { &v2, &v0, &v1 };
+        float a[3], b[3], c[3], slack[3];
+        for (int e = 0; e < 3; ++e)
+        {
+            a[e] = corners[e]->y - ends[e]->y;
+            b[e] = ends[e]->x - corners[e]->x;
+            c[e] = corners[e]->x * ends[e]->y - ends[e]->x * corners[e]->y;
+            slack[e] = 0.5f * (fabs(a[e]) + fabs(b[e]));
+        }
+        // depth plane, and how far it rises from a pixel center to the farthest corner
+        float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        float zSlack = 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float * row = farthest + (y - rowBegin) * OCCLUSION_WIDTH;
+            for (int x = minX & ~3; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+                __m128 touched = laneRange(x, minX, maxX);
+                for (int e = 0; e < 3; ++e)
+                {
+                    __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[e]), px), _mm_set1_ps(b[e] * py + c[e] + slack[e]));
+                    touched = _mm_and_ps(touched, _mm_cmpge_ps(edge, zero));
+                }
+                if (!_mm_movemask_ps(touched))
+                    continue;
+                __m128 z = _mm_add_ps(_mm_set1_ps(v0.z + dzdy * (py - v0.y) + zSlack), _mm_mul_ps(_mm_set1_ps(dzdx), _mm_sub_ps(px, _mm_set1_ps(v0.x))));
+                __m128 current = _mm_load_ps(row + x);
+                __m128 farther = _mm_max_ps(current, z);
+                _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(touched, farther), _mm_andnot_ps(touched, current)));
+            }
+        }
+    }
+
+    // mark every pixel an outline edge may pass through: inside the edge's box and
+    // with the line no farther from the center than the pixel reaches
+    void rasterOutline (const glm::vec2 * ends, int rowBegin, int rowMin, int rowMax, float * crossed)
+    {
+        const glm::vec2 & p = ends[0], & q = ends[1];
+        int minY = std::max(rowMin, (int)floor(std::min(p.y, q.y)));
+        int maxY = std::min(rowMax, (int)floor(std::max(p.y, q.y)));
+        int minX = std::max(0, (int)floor(std::min(p.x, q.x)));
+        int maxX = std::min(OCCLUSION_WIDTH - 1, (int)floor(std::max(p.x, q.x)));
+        if (minY > maxY || minX > maxX)
+            return;
+
+        float a = p.y - q.y, b = q.x - p.x, c = p.x * q.y - q.x * p.y;
+        // a little extra so rounding never lets the line slip past a pixel
+        float reach = 0.5f * (fabs(a) + fabs(b)) * 1.001f + 1e-4f;
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float * row = crossed + (y - rowBegin) * OCCLUSION_WIDTH;
+            for (int x = minX & ~3; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+                __m128 line = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a), px), _mm_set1_ps(b * (y + 0.5f) + c));
+                __m128 hit = _mm_and_ps(laneRange(x, minX, maxX), _mm_cmple_ps(_mm_and_ps(line, magnitude), _mm_set1_ps(reach)));
+                _mm_store_ps(row + x, _mm_or_ps(_mm_load_ps(row + x), hit));
+            }
+        }
+    }
+
+    // conservative screen rectangle and nearest depth of the sphere, then visible
+    // as soon as any covered pixel holds depth behind that nearest point
+    unsigned char query (const glm::vec4 & sphere) const
+    {
+        glm::vec3 center = glm::vec3(m_view * glm::vec4(glm::vec3(sphere), 1.0f));
+        float radius = sphere.w, distance = -center.z;
+        if (distance - radius <= m_near)
+            return QUERY_VISIBLE;
+
+        // extremes of x / depth over the box around the sphere
+        float nearDistance = distance - radius, farDistance = distance + radius;
+        float x0 = center.x - radius, x1 = center.x + radius, y0 = center.y - radius, y1 = center.y + radius;
+        float ndcX0 = m_projection[0][0] * x0 / (x0 >= 0.0f ? farDistance : nearDistance);
+        float ndcX1 = m_projection[0][0] * x1 / (x1 >= 0.0f ? nearDistance : farDistance);
+        float ndcY0 = m_projection[1][1] * y0 / (y0 >= 0.0f ? farDistance : nearDistance);
+        float ndcY1 = m_projection[1][1] * y1 / (y1 >= 0.0f ? nearDistance : farDistance);
+        int minX = std::max(0, (int)floor((ndcX0 * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+        int maxX = std::min(OCCLUSION_WIDTH - 1, (int)floor((ndcX1 * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+        int minY = std::max(0, (int)floor((ndcY0 * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+        int maxY = std::min(OCCLUSION_HEIGHT - 1, (int)floor((ndcY1 * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+        float nearDepth = (m_projection[2][2] * -nearDistance + m_projection[3][2]) / nearDistance * 0.5f + 0.5f;
+        if (minX > maxX || minY > maxY || nearDepth > 1.0f)
+            return QUERY_OUTSIDE;
+
+        __m128 queryDepth = _mm_set1_ps(nearDepth);
+        __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        for (int y = minY; y <= maxY; ++y)
+        {
+            const float * row = &m_depth[y * OCCLUSION_WIDTH];
+            for (int x = minX & ~3; x <= maxX; x += 4)
+            {
+                // lanes of the rectangle only, then any pixel not in front of the query
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                __m128 inRect = _mm_and_ps(_mm_cmpge_ps(px, _mm_set1_ps((float)minX)), _mm_cmple_ps(px, _mm_set1_ps((float)maxX)));
+                __m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), queryDepth);
+                if (_mm_movemask_ps(_mm_and_ps(inRect, behind)))
+                    return QUERY_VISIBLE;
+            }
+        }
+        return QUERY_OCCLUDED;
+    }
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Shader.hpp"
+
+// GPU occlusion culling per node subtree: before a marked subtree is drawn its
+// bounding box goes out with colour and depth writes off inside a
+// GL_ANY_SAMPLES_PASSED query. The answer is read back a frame later, and only
+// when it is already there, so nothing waits on the GPU:
+//   visible last frame -> drawn normally, the new query refreshes the prediction
+//   hidden last frame  -> drawn inside glBeginConditionalRender on the query, so
+//                         the GPU drops it in that one test, or (conditional off)
+//                         skipped on the CPU until a query says it is back
+// The boxes are learnt from what the subtree drew, in the subtree root's frame
+// --------------------------------------------------------------------------------
+
+// axis aligned box in a subtree root's frame, grown by every part drawn below it
+struct SubtreeBounds {
+    glm::vec3 min, max;
+
+    SubtreeBounds ()
+        : min(1e30f), max(-1e30f) {}
+
+    bool valid () const
+    {
+        return min.x <= max.x;
+    }
+
+    // parts are the unit cube or the radius 0.5 sphere under `local`
+    void extend (const glm::mat4 & local)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec3 corner = glm::vec3(local * glm::vec4(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f, 1.0f));
+            min = glm::min(min, corner);
+            max = glm::max(max, corner);
+        }
+    }
+};
+
+// frames a subtree instance may go undrawn before its query is deleted
+const unsigned int SUBTREE_QUERY_KEEP_FRAMES = 120;
+
+// one subtree instance's query and the visibility it last reported
+struct SubtreeQuery {
+    unsigned int query;
+    bool visible; // prediction for this frame
+    bool issued;  // a result is still to be read
+    unsigned int lastFrame; // begin() count when the subtree was last drawn
+
+    SubtreeQuery ()
+        : query(0), visible(true), issued(false), lastFrame(0) {}
+};
+
+class OcclusionQueries {
+public:
+    // hidden subtrees go out under conditional rendering instead of being skipped
+    bool m_conditional;
+    // this frame: boxes queried, subtrees predicted hidden, of those skipped on the
+    // CPU, results not back yet
+    unsigned int m_issued, m_hidden, m_skipped, m_pending;
+
+    OcclusionQueries ()
+        : m_conditional(true), m_issued(0), m_hidden(0), m_skipped(0), m_pending(0),
+          m_boxShader(nullptr), m_boxVAO(0), m_frame(0), m_conditionalDepth(-1) {}
+
+    // boxes are drawn with a position-only program (model/view/projection) from the
+    // position-only unit cube
+    void init (const Shader & boxShader, unsigned int boxVAO)
+    {
+        m_boxShader = &boxShader;
+        m_boxVAO = boxVAO;
+    }
+
+    // needs the GL context the queries were made in
+    void destroy ()
+    {
+        for (auto & entry : m_queries)
+            if (entry.second.query)
+                glDeleteQueries(1, &entry.second.query);
+        m_queries.clear();
+    }
+
+    void begin (const glm::mat4 & view, const glm::mat4 & projection)
+    {
+        // instances gone from the scene (a smaller crowd, culled on the CPU) give
+        // their queries back
+        m_frame++;
+        for (auto entry = m_queries.begin(); entry != m_queries.end();)
+        {
+            if (m_frame - entry->second.lastFrame <= SUBTREE_QUERY_KEEP_FRAMES)
+            {
+                ++entry;
+                continue;
+            }
+            if (entry->second.query)
+                glDeleteQueries(1, &entry->second.query);
+            entry = m_queries.erase(entry);
+        }
+
+        m_issued = m_hidden = m_skipped = m_pending = 0;
+        m_cameraPosition = glm::vec3(glm::inverse(view)[3]);
+        m_boxShader->use();
+        m_boxShader->setMat4("view", view);
+        m_boxShader->setMat4("projection", projection);
+    }
+
+    // called as a marked subtree starts drawing with its root at `model`; false means
+    // skip it. Every true has to be matched by endSubtree() once the subtree is drawn
+    bool beginSubtree (const void * node, unsigned int instance, const glm::mat4 & model, SubtreeBounds & bounds)
+    {
+        SubtreeQuery & state = m_queries[std::make_pair(node, instance)];
+        state.lastFrame = m_frame;
+        if (!state.query)
+            glGenQueries(1, &state.query);
+        if (state.issued)
+        {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint anySamples = 0;
+                glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &anySamples);
+                state.visible = anySamples != 0;
+                state.issued = false;
+            }
+            else
+                m_pending++;
+        }
+
+        // the camera inside the box clips its faces away: always visible
+        glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(m_cameraPosition, 1.0f));
+        bool inside = !bounds.valid() || (glm::all(glm::greaterThanEqual(camera, bounds.min - 0.5f))
+                                          && glm::all(glm::lessThanEqual(camera, bounds.max + 0.5f)));
+        if (inside)
+            state.visible = true;
+        // inside a parent's conditional render the parent's answer decides
+        else if (!state.issued && m_conditionalDepth < 0)
+        {
+            drawBox(state.query, model, bounds);
+            state.issued = true;
+            m_issued++;
+        }
+
+        if (!state.visible)
+        {
+            m_hidden++;
+            if (!m_conditional)
+            {
+                m_skipped++;
+                return false;
+            }
+            if (m_conditionalDepth < 0 && state.issued)
+            {
+                glBeginConditionalRender(state.query, GL_QUERY_WAIT);
+                m_conditionalDepth = m_roots.size();
+            }
+        }
+        m_roots.push_back(Root { &bounds, glm::inverse(model) });
+        return true;
+    }
+
+    void endSubtree ()
+    {
+        m_roots.pop_back();
+        if (m_conditionalDepth == (int)m_roots.size())
+        {
+            glEndConditionalRender();
+            m_conditionalDepth = -1;
+        }
+    }
+
+    // a part drawn (or queued as an impostor) at `model`, grows every open root's box
+    void record (const glm::mat4 & model)
+    {
+        for (Root & root : m_roots)
+            root.bounds->extend(root.inverse * model);
+    }
+
+private:
+    struct Root {
+        SubtreeBounds * bounds;
+        glm::mat4 inverse; // world to the root's frame
+    };
+
+    const Shader * m_boxShader;
+    unsigned int m_boxVAO;
+    glm::vec3 m_cameraPosition;
+    unsigned int m_frame; // begin() calls so far
+    std::map<std::pair<const void *, unsigned int>, SubtreeQuery> m_queries;
+    std::vector<Root> m_roots;
+    int m_conditionalDepth; // m_roots size when the active conditional render began, -1 for none
+
+    void drawBox (unsigned int query, const glm::mat4 & model, const SubtreeBounds & bounds)
+    {
+        // whatever depth test is current (GL_EQUAL after a pre-pass) would reject the
+        // box's own surface, LEQUAL passes it wherever nothing is in front
+        GLint depthFunc;
+        GLboolean depthMask;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+
+        glm::mat4 box = glm::scale(glm::translate(model, 0.5f * (bounds.min + bounds.max)), bounds.max - bounds.min);
+        m_boxShader->use();
+        m_boxShader->setMat4("model", box);
+        glBindVertexArray(m_boxVAO);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        glDepthFunc(depthFunc);
+        glDepthMask(depthMask);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+};
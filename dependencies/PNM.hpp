@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MappedFile.hpp"
+
+// netpbm reader: plain P2/P3 (ASCII) and raw P5/P6 (binary), always returns 8 bit
+// channels. Raw images with maxval 255 point straight into the mapped file.
+// --------------------------------------------------------------------------------
+
+struct PNMImage {
+    int width, height, channels, maxval;
+    const unsigned char * pixels;       // width * height * channels bytes
+    std::vector<unsigned char> storage; // used whenever pixels had to be converted
+    MappedFile mapping;                 // only for images opened with loadPNM(path)
+
+    PNMImage ()
+        : width(0), height(0), channels(0), maxval(0), pixels(NULL) {}
+};
+
+inline bool isPNMPath (const char * path)
+{
+    std::string name(path);
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string ext = name.substr(dot + 1);
+    return ext == "ppm" || ext == "pgm" || ext == "pnm" || ext == "PPM" || ext == "PGM" || ext == "PNM";
+}
+
+inline bool pnmSpace (unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// skip whitespace and '#' comments in the header
+inline const unsigned char * pnmSkip (const unsigned char * p, const unsigned char * end)
+{
+    while (p < end)
+    {
+        if (*p == '#')
+            while (p < end && *p != '\n')
+                ++p;
+        else if (pnmSpace(*p))
+            ++p;
+        else
+            break;
+    }
+    return p;
+}
+
+inline const unsigned char * pnmHeaderInt (const unsigned char * p, const unsigned char * end, int & value)
+{
+    p = pnmSkip(p, end);
+    value = 0;
+    const unsigned char * start = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    return p == start ? NULL : p;
+}
+
+// scalar reference parser: decimal values separated by whitespace
+// returns the number of values parsed
+inline size_t parsePNMValuesScalar (const unsigned char * p, const unsigned char * end, unsigned short * out, size_t count)
+{
+    size_t parsed = 0;
+    while (parsed < count)
+    {
+        while (p < end && !(*p >= '0' && *p <= '9'))
+            ++p;
+        if (p == end)
+            break;
+        unsigned int value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+        out[parsed++] = value;
+    }
+    return parsed;
+}
+
+// vectorised parser: classifies 16 bytes at a time into a digit bitmask; number starts
+// are the rising edges of that mask, and values of up to three digits are assembled
+// without a per-digit loop from the first three bytes and per-length multipliers
+inline size_t parsePNMValues (const unsigned char * p, const unsigned char * end, unsigned short * out, size_t count)
+{
+#if defined(__SSE2__)
+    // weights of the first three digits for a number of length 1, 2 and 3
+    static const unsigned int WEIGHT0[4] = { 0, 1, 10, 100 };
+    static const unsigned int WEIGHT1[4] = { 0, 0, 1, 10 };
+    static const unsigned int WEIGHT2[4] = { 0, 0, 0, 1 };
+
+    size_t parsed = 0;
+    const __m128i bias = _mm_set1_epi8((char)(0x80 - '0'));
+    const __m128i limit = _mm_set1_epi8((char)(0x80 + 9));
+    unsigned int carry = 0; // last byte of the previous block was a digit
+
+    // keep 16 bytes of slack so numbers running past a block can be read in place
+    while (p + 32 <= end && parsed < count)
+    {
+        // signed compare trick: (c - '0') as unsigned <= 9
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        __m128i shifted = _mm_add_epi8(bytes, bias);
+        unsigned int digits = ~_mm_movemask_epi8(_mm_cmpgt_epi8(shifted, limit)) & 0xFFFF;
+        // a number starts on a digit whose predecessor is not one
+        unsigned int starts = digits & ~((digits << 1) | carry);
+        carry = digits >> 15;
+
+        while (starts)
+        {
+            unsigned int position = __builtin_ctz(starts);
+            starts &= starts - 1;
+            const unsigned char * digit = p + position;
+
+            unsigned int run = __builtin_ctz(~(digits >> position));
+            if (position + run == 16)
+            {
+                // the run reaches the end of the block, measure it byte by byte
+                while (digit + run < end && digit[run] >= '0' && digit[run] <= '9')
+                    ++run;
+            }
+
+            unsigned int value;
+            if (run <= 3)
+            {
+                value = (digit[0] - '0') * WEIGHT0[run]
+                      + (unsigned char)(digit[1] - '0') * WEIGHT1[run]
+                      + (unsigned char)(digit[2] - '0') * WEIGHT2[run];
+            }
+            else
+            {
+                value = 0;
+                for (unsigned int i = 0; i < run; ++i)
+                    value = value * 10 + (digit[i] - '0');
+            }
+            out[parsed++] = value;
+            if (parsed == count)
+                return parsed;
+        }
+        p += 16;
+    }
+
+    // skip the rest of a number the last block already consumed, then finish in scalar code
+    if (carry)
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+    if (parsed < count)
+        parsed += parsePNMValuesScalar(p, end, out + parsed, count - parsed);
+    return parsed;
+#else
+    return parsePNMValuesScalar(p, end, out, count);
+#endif
+}
+
+inline unsigned char pnmScale (unsigned int value, int maxval)
+{
+    if (maxval == 255)
+        return value > 255 ? 255 : value;
+    if (value > (unsigned int)maxval)
+        value = maxval;
+    return (unsigned char)((value * 255 + maxval / 2) / maxval);
+}
+
+// decode from memory; raw maxval 255 images keep pointing into bytes (zero copy)
+// -----------------------------------------------------------------------------
+inline bool decodePNM (const unsigned char * bytes, size_t size, PNMImage & image)
+{
+    const unsigned char * end = bytes + size;
+    if (size < 3 || bytes[0] != 'P')
+        return false;
+    char kind = bytes[1];
+    if (kind != '2' && kind != '3' && kind != '5' && kind != '6')
+        return false;
+
+    const unsigned char * p = bytes + 2;
+    int width, height, maxval;
+    if (!(p = pnmHeaderInt(p, end, width)) || !(p = pnmHeaderInt(p, end, height)) || !(p = pnmHeaderInt(p, end, maxval)))
+        return false;
+    if (width <= 0 || height <= 0 || maxval <= 0 || maxval > 65535 || p == end)
+        return false;
+    // exactly one whitespace byte separates the header from the raster
+    ++p;
+
+    image.width = width;
+    image.height = height;
+    image.maxval = maxval;
+    image.channels = (kind == '3' || kind == '6') ? 3 : 1;
+    size_t count = (size_t)width * height * image.channels;
+
+    if (kind == '5' || kind == '6')
+    {
+        size_t sampleBytes = maxval > 255 ? 2 : 1;
+        if ((size_t)(end - p) < count * sampleBytes)
+            return false;
+        if (maxval == 255)
+        {
+            image.pixels = p;
+            return true;
+        }
+        image.storage.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            // 16 bit samples are big endian
+            unsigned int value = sampleBytes == 2 ? (p[2 * i] << 8 | p[2 * i + 1]) : p[i];
+            image.storage[i] = pnmScale(value, maxval);
+        }
+        image.pixels = &image.storage[0];
+        return true;
+    }
+
+    std::vector<unsigned short> values(count);
+    if (parsePNMValues(p, end, &values[0], count) != count)
+        return false;
+    image.storage.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        image.storage[i] = pnmScale(values[i], maxval);
+    image.pixels = &image.storage[0];
+    return true;
+}
+
+// map the file and decode; raw images stay in the mapping
+inline bool loadPNM (const char * path, PNMImage & image)
+{
+    if (!image.mapping.open(path))
+        return false;
+    return decodePNM(image.mapping.data(), image.mapping.size(), image);
+}
+
+// raw P6 writer for GL read backs: rows come bottom first and are flipped on the way out
+inline bool savePPM (const char * path, int width, int height, const unsigned char * rgb)
+{
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool written = true;
+    for (int y = height - 1; y >= 0 && written; --y)
+        written = fwrite(rgb + (size_t)y * width * 3, 1, (size_t)width * 3, file) == (size_t)width * 3;
+    return fclose(file) == 0 && written;
+}
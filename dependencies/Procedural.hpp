@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.hpp"
+
+// shapes generated by procedural_vertex.glsl
+enum ProceduralPrimitive {
+    PROCEDURAL_CUBE = 0,
+    PROCEDURAL_SPHERE = 1,
+    PROCEDURAL_CAPSULE = 2
+};
+
+// texture unit the instance matrices are bound to for instanced draws
+const int PROCEDURAL_INSTANCE_UNIT = 3;
+
+// number of gl_VertexID values a primitive needs (triangle list)
+inline unsigned int proceduralVertexCount (ProceduralPrimitive primitive, unsigned int segments)
+{
+    switch (primitive)
+    {
+    case PROCEDURAL_CUBE:
+        return 36;
+    case PROCEDURAL_SPHERE:
+        return 6 * segments * segments;
+    case PROCEDURAL_CAPSULE:
+        // segments must be even so the equator splits the caps, plus one cylinder band
+        return 6 * segments * (segments + 1);
+    }
+    return 0;
+}
+
+// draws primitives without any vertex buffer: an empty VAO plus gl_VertexID
+// -------------------------------------------------------------------------
+class ProceduralPrimitives {
+public:
+    unsigned int m_VAO;
+
+    ProceduralPrimitives ()
+        : m_VAO(0), m_instanceBuffer(0), m_instanceTexture(0) {}
+
+    // needs a current GL context; core profile still wants a VAO bound for any draw
+    void init ()
+    {
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_instanceBuffer);
+        glGenTextures(1, &m_instanceTexture);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, m_instanceTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instanceBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // register the procedural_vertex.glsl twin of a mesh shader (same fragment stage)
+    void addVariant (const Shader & meshShader, const Shader & proceduralShader)
+    {
+        m_variants[meshShader.ID] = &proceduralShader;
+    }
+
+    const Shader & variant (const Shader & meshShader) const
+    {
+        std::unordered_map<unsigned int, const Shader*>::const_iterator it = m_variants.find(meshShader.ID);
+        return it != m_variants.end() ? *it->second : meshShader;
+    }
+
+    // register the SHADER_INSTANCED procedural twin of a mesh shader
+    void addInstancedVariant (const Shader & meshShader, const Shader & instancedShader)
+    {
+        m_instancedVariants[meshShader.ID] = &instancedShader;
+    }
+
+    // NULL when the mesh shader has no instanced twin
+    const Shader * instancedVariant (const Shader & meshShader) const
+    {
+        std::unordered_map<unsigned int, const Shader*>::const_iterator it = m_instancedVariants.find(meshShader.ID);
+        return it != m_instancedVariants.end() ? it->second : NULL;
+    }
+
+    // single draw, "model" is expected to be set on the shader already
+    void draw (const Shader & shader, ProceduralPrimitive primitive, unsigned int segments) const
+    {
+        shader.setInt("primitive", primitive);
+        shader.setInt("segments", segments);
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, proceduralVertexCount(primitive, segments));
+    }
+
+    // the matrices instanced draws read through gl_InstanceID, until the next call
+    void setInstances (const std::vector<glm::mat4> & models)
+    {
+        if (models.empty())
+            return;
+        glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, models.size() * sizeof(glm::mat4), &models[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // one draw for instances first .. first + count - 1 of setInstances(), each placing
+    // "model" (set on the shader already) inside its matrix; the shader has to be
+    // built with SHADER_INSTANCED
+    void drawInstanced (const Shader & shader, ProceduralPrimitive primitive, unsigned int segments,
+                        unsigned int first, unsigned int count) const
+    {
+        if (!count)
+            return;
+        glActiveTexture(GL_TEXTURE0 + PROCEDURAL_INSTANCE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, m_instanceTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setInt("primitive", primitive);
+        shader.setInt("segments", segments);
+        shader.setInt("instanceModels", PROCEDURAL_INSTANCE_UNIT);
+        shader.setInt("instanceBase", first);
+        glBindVertexArray(m_VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, proceduralVertexCount(primitive, segments), count);
+    }
+
+private:
+    unsigned int m_instanceBuffer, m_instanceTexture;
+    std::unordered_map<unsigned int, const Shader*> m_variants;
+    std::unordered_map<unsigned int, const Shader*> m_instancedVariants;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "MappedFile.hpp"
+
+// linked program binaries: glGetProgramBinary blobs stored under PROGRAM_CACHE_DIR,
+// keyed by the GLSL sources and the driver, so a warm start skips compile and link.
+// ARB_get_program_binary is core in 4.1 only, our glad is 3.3, hence the pointers
+// --------------------------------------------------------------------------------
+
+#define PROGRAM_CACHE_DIR "../cache/"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP PFNGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei * length, GLenum * binaryFormat, void * binary);
+typedef void (APIENTRYP PFNPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void * binary, GLsizei length);
+typedef void (APIENTRYP PFNPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat, size;
+};
+
+class ProgramCache {
+public:
+    bool enabled;
+
+    // startup numbers: programs per path and the milliseconds spent on each
+    unsigned int m_loaded, m_compiled, m_rejected;
+    double m_loadMs, m_compileMs;
+
+    ProgramCache ()
+        : enabled(true), m_loaded(0), m_compiled(0), m_rejected(0), m_loadMs(0.0), m_compileMs(0.0),
+          m_supported(false), m_driverHash(0),
+          m_getProgramBinary(NULL), m_programBinary(NULL), m_programParameteri(NULL) {}
+
+    // once after gladLoadGLLoader, with the same loader; without it (or without any
+    // binary format) every Shader compiles from source as before
+    void init (GLADloadproc load)
+    {
+        m_getProgramBinary = (PFNGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        m_programBinary = (PFNPROGRAMBINARYPROC)load("glProgramBinary");
+        m_programParameteri = (PFNPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+
+        GLint formats = 0;
+        if (m_getProgramBinary && m_programBinary && m_programParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // older drivers raise GL_INVALID_ENUM for the query, don't leave it for the frame loop
+        while (glGetError() != GL_NO_ERROR) {}
+        m_supported = formats > 0;
+
+        // a blob is only valid for the driver build that produced it
+        m_driverHash = hashBytes((const unsigned char *)"", 0);
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION })
+        {
+            const char * value = (const char *)glGetString(name);
+            if (value)
+                m_driverHash = hashBytes((const unsigned char *)value, strlen(value) + 1, m_driverHash);
+        }
+    }
+
+    bool active () const
+    {
+        return enabled && m_supported;
+    }
+
+    uint64_t key (const std::string & vertexCode, const std::string & fragmentCode) const
+    {
+        uint64_t hash = hashBytes((const unsigned char *)vertexCode.c_str(), vertexCode.size() + 1, m_driverHash);
+        return hashBytes((const unsigned char *)fragmentCode.c_str(), fragmentCode.size() + 1, hash);
+    }
+
+    // a linked program from the cache, or 0 when there is none or the driver rejects it
+    unsigned int load (uint64_t key)
+    {
+        if (!active())
+            return 0;
+        MappedFile file(path(key).c_str());
+        if (!file.valid() || file.size() < sizeof(ProgramCacheHeader))
+            return 0;
+        ProgramCacheHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, "GPRG", 4) != 0 || header.version != PROGRAM_CACHE_VERSION
+            || header.key != key || sizeof(header) + header.size > file.size())
+            return 0;
+
+        unsigned int program = glCreateProgram();
+        m_programBinary(program, header.binaryFormat, file.data() + sizeof(header), header.size);
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // driver update or a corrupt file; the source path rewrites the entry
+            glDeleteProgram(program);
+            m_rejected++;
+            return 0;
+        }
+        return program;
+    }
+
+    // before glLinkProgram, so the driver keeps the binary around
+    void prepare (unsigned int program) const
+    {
+        if (active())
+            m_programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // after a successful link; temporary name first so a crash never leaves a torn file
+    void store (uint64_t key, unsigned int program) const
+    {
+        if (!active())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<unsigned char> blob(length);
+        GLenum format = 0;
+        m_getProgramBinary(program, length, &length, &format, &blob[0]);
+
+        ProgramCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "GPRG", 4);
+        header.version = PROGRAM_CACHE_VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.size = length;
+
+        mkdir(PROGRAM_CACHE_DIR, 0755);
+        std::string target = path(key), temp = target + ".tmp";
+        FILE * file = fopen(temp.c_str(), "wb");
+        if (!file)
+            return;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&blob[0], 1, length, file) == (size_t)length;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(temp.c_str(), target.c_str()) != 0)
+        {
+            remove(temp.c_str());
+            std::cout << "WARNING::PROGRAM_CACHE::WRITE_FAILED " << target << std::endl;
+        }
+    }
+
+    void record (bool fromCache, double ms)
+    {
+        if (fromCache)
+        {
+            m_loaded++;
+            m_loadMs += ms;
+        }
+        else
+        {
+            m_compiled++;
+            m_compileMs += ms;
+        }
+    }
+
+    void report () const
+    {
+        std::cout << "shader programs: " << m_loaded << " from cache in " << m_loadMs << " ms, "
+                  << m_compiled << " compiled in " << m_compileMs << " ms";
+        if (m_rejected)
+            std::cout << " (" << m_rejected << " cached binaries rejected)";
+        if (!m_supported)
+            std::cout << " (no program binary support)";
+        std::cout << std::endl;
+    }
+
+private:
+    bool m_supported;
+    uint64_t m_driverHash;
+    PFNGETPROGRAMBINARYPROC m_getProgramBinary;
+    PFNPROGRAMBINARYPROC m_programBinary;
+    PFNPROGRAMPARAMETERIPROC m_programParameteri;
+
+    static std::string path (uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.glprog", (unsigned long long)key);
+        return std::string(PROGRAM_CACHE_DIR) + name;
+    }
+};
+
+inline ProgramCache & programCache ()
+{
+    static ProgramCache cache;
+    return cache;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+// framebuffer the passes with a target of their own (G-buffer, shadow cubes, virtual
+// texture feedback) go back to: 0 is the window, a RenderTarget when headless
+inline unsigned int & defaultFramebuffer ()
+{
+    static unsigned int framebuffer = 0;
+    return framebuffer;
+}
+
+// offscreen colour + depth/stencil framebuffer standing in for a window's
+// --------------------------------------------------------------------------------
+class RenderTarget {
+public:
+    int m_width, m_height;
+
+    RenderTarget ()
+        : m_width(0), m_height(0), m_FBO(0)
+    {
+        m_renderbuffers[0] = m_renderbuffers[1] = 0;
+    }
+
+    // needs a current GL context
+    bool init (int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        glGenFramebuffers(1, &m_FBO);
+        glGenRenderbuffers(2, m_renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::RENDER_TARGET::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+        return complete;
+    }
+
+    // from here on the target is what every pass draws into instead of the window
+    void makeDefault () const
+    {
+        defaultFramebuffer() = m_FBO;
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    }
+
+    // the colour as tightly packed RGB rows, bottom row first
+    void read (unsigned char * rgb) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, defaultFramebuffer());
+    }
+
+    void destroy ()
+    {
+        if (defaultFramebuffer() == m_FBO)
+            defaultFramebuffer() = 0;
+        glDeleteFramebuffers(1, &m_FBO);
+        glDeleteRenderbuffers(2, m_renderbuffers);
+        m_FBO = 0;
+    }
+
+private:
+    unsigned int m_FBO;
+    unsigned int m_renderbuffers[2]; // colour, depth/stencil
+};
@@ -3,140 +3,222 @@
 #include "glad/glad.h"
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderCompiler.hpp"
+#include "ShaderSource.hpp"
+
+// read, preprocess and compile (or load from the program cache) one program. With
+// `replaces` set the result is a rebuild of that Shader's program for the hot reload,
+// swapped in by ShaderCompiler once it links; 0 then means the sources were unreadable
+// ------------------------------------------------------------------------------------
+inline unsigned int buildProgram (const char * vertexPath, const char * fragmentPath, const std::vector<std::string> & defines,
+                                  unsigned int replaces = 0, std::vector<std::string> * sources = NULL)
+{
+    std::string vertexCode;
+    std::string fragmentCode;
+    // read both files, #include and #define expanded (ShaderSource.hpp)
+    if (!preprocessShader(vertexPath, defines, vertexCode, sources) || !preprocessShader(fragmentPath, defines, fragmentCode, sources))
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        if (replaces)
+            return 0;
+    }
+
+    // linked binary from an earlier run, see ProgramCache.hpp
+    ProgramCache & cache = programCache();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t cacheKey = cache.key(vertexCode, fragmentCode);
+    unsigned int program = cache.load(cacheKey);
+    if (program)
+    {
+        cache.record(true, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (replaces)
+            shaderCompiler().replace(replaces, program);
+        return program;
+    }
+
+    const char * vShaderCode = vertexCode.c_str();
+    const char * fShaderCode = fragmentCode.c_str();
+
+    // compile and link without asking for the status, which would wait for the
+    // driver; ShaderCompiler checks errors once the program is done
+    unsigned int vertex, fragment;
+    // vertex Shader
+    vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vShaderCode, NULL);
+    glCompileShader(vertex);
+
+    fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &fShaderCode, NULL);
+    glCompileShader(fragment);
+
+    // create program
+    program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    cache.prepare(program);
+    glLinkProgram(program);
+    shaderCompiler().submit(program, vertex, fragment, cacheKey,
+                            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), replaces);
+    return program;
+}
 
 struct Shader {
     unsigned int ID;
     float opacity = 0.0;
     
-    Shader(const char * vertexPath, const char * fragmentPath)
+    // defines are the permutation switches (see ShaderFeature), both stages get all of them;
+    // sources (if given) receives every file read, includes too
+    Shader(const char * vertexPath, const char * fragmentPath, const std::vector<std::string> & defines = std::vector<std::string>(),
+           std::vector<std::string> * sources = NULL)
     {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file’s buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch(std::ifstream::failure e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-
-        const char * vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-
-        unsigned int vertex, fragment;
-        int success;
-        char infoLog[512];
-        // vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if(!success)
-        {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
-            infoLog << std::endl;
-        };
-
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // print compile errors if any
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if(!success)
-        {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" <<
-            infoLog << std::endl;
-        };
-
-        // create program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        // print linking errors if any
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
-        if(!success)
-        {
-            glGetProgramInfoLog(ID, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" <<
-            infoLog << std::endl;
-        }
-        // delete shaders; they’re linked into our program and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        ID = buildProgram(vertexPath, fragmentPath, defines, 0, sources);
+    };
 
+    // false while the program is still compiling (or failed), draws use the fallback meanwhile
+    bool ready() const
+    {
+        return shaderCompiler().ready(ID);
     };
 
     void use() const
     {
-        glUseProgram(ID);
+        glUseProgram(shaderCompiler().resolve(ID));
     };
 
     void setBool(const std::string& name, bool value) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform1i(location, (int)value);
+        setUniform(name, [=](int location) { glUniform1i(location, (int)value); });
     };
 
     void setInt(const std::string& name, int value) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform1i(location, value);
+        setUniform(name, [=](int location) { glUniform1i(location, value); });
     };
     
     void setFloat(const std::string& name, float value) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform1f(location, value);
+        setUniform(name, [=](int location) { glUniform1f(location, value); });
     };
 
     void setFloat(const std::string& name, float first, float second, float third, float fourth) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform4f(location, first, second, third, fourth);
+        setUniform(name, [=](int location) { glUniform4f(location, first, second, third, fourth); });
     };
 
     void setMat4 (const std::string& name, glm::mat4 matrix) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix));
+        setUniform(name, [=](int location) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix)); });
     }
 
     void setVec3 (const std::string & name, glm::vec3 vector) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform3fv(location, 1, &vector[0]);
+        setUniform(name, [=](int location) { glUniform3fv(location, 1, &vector[0]); });
     }
 
     void setVec3 (const std::string & name, float x, float y, float z) const
     {
-        int location = glGetUniformLocation(ID, name.c_str());
-        glUniform3f(location, x, y, z);
+        setUniform(name, [=](int location) { glUniform3f(location, x, y, z); });
     }
-};
\ No newline at end of file
+
+    void setVec4 (const std::string & name, glm::vec4 vector) const
+    {
+        setUniform(name, [=](int location) { glUniform4fv(location, 1, &vector[0]); });
+    }
+
+private:
+    // on the linked program, or on the fallback and again on the program once it links
+    template <typename Set>
+    void setUniform (const std::string & name, Set set) const
+    {
+        ShaderCompiler & compiler = shaderCompiler();
+        unsigned int program = compiler.resolve(ID);
+        set(glGetUniformLocation(program, name.c_str()));
+        if (program != ID)
+            compiler.defer(ID, name, set);
+    }
+};
+
+// permutation switches, each one a #define in both stages
+// -------------------------------------------------------
+enum ShaderFeature {
+    SHADER_TEXTURED = 1 << 0, // albedo from the texture array instead of objectColor
+    SHADER_SPECULAR = 1 << 1, // Phong highlight on top of ambient and diffuse
+    SHADER_INSTANCED = 1 << 2, // procedural_vertex.glsl reads model matrices per gl_InstanceID
+    SHADER_DEFERRED = 1 << 3,  // lighting.glsl writes the G-buffer instead of shading
+    SHADER_DEPTH_ONLY = 1 << 4 // impostor_fragment.glsl stops after gl_FragDepth (depth pre-pass)
+};
+
+inline std::vector<std::string> shaderDefines (unsigned int features)
+{
+    std::vector<std::string> defines;
+    if (features & SHADER_TEXTURED)
+        defines.push_back("TEXTURED");
+    if (features & SHADER_SPECULAR)
+        defines.push_back("SPECULAR");
+    if (features & SHADER_INSTANCED)
+        defines.push_back("INSTANCED");
+    if (features & SHADER_DEFERRED)
+        defines.push_back("DEFERRED");
+    if (features & SHADER_DEPTH_ONLY)
+        defines.push_back("DEPTH_ONLY");
+    return defines;
+}
+
+// one program per (vertex, fragment, features), built on first request and kept;
+// returned references stay valid for the lifetime of the cache
+// -------------------------------------------------------------------------------
+class ShaderVariants {
+public:
+    const Shader & get (const char * vertexPath, const char * fragmentPath, unsigned int features = 0)
+    {
+        std::string key = std::string(vertexPath) + "|" + fragmentPath + "|" + std::to_string(features);
+        std::unordered_map<std::string, Variant>::iterator it = m_shaders.find(key);
+        if (it == m_shaders.end())
+        {
+            std::vector<std::string> sources;
+            Shader shader(vertexPath, fragmentPath, shaderDefines(features), &sources);
+            Variant variant = { shader, vertexPath, fragmentPath, features, sources };
+            it = m_shaders.emplace(key, variant).first;
+        }
+        return it->second.shader;
+    }
+
+    unsigned int size () const
+    {
+        return m_shaders.size();
+    }
+
+    // rebuild every variant that read `path`, directly or through an #include; the
+    // Shader handles stay the same and keep their old program should the new one fail
+    unsigned int reload (const std::string & path)
+    {
+        unsigned int count = 0;
+        for (std::pair<const std::string, Variant> & entry : m_shaders)
+        {
+            Variant & variant = entry.second;
+            if (std::find(variant.sources.begin(), variant.sources.end(), path) == variant.sources.end())
+                continue;
+            std::vector<std::string> sources;
+            if (buildProgram(variant.vertexPath.c_str(), variant.fragmentPath.c_str(), shaderDefines(variant.features), variant.shader.ID, &sources))
+                variant.sources = sources;
+            count++;
+        }
+        return count;
+    }
+
+private:
+    struct Variant {
+        Shader shader;
+        std::string vertexPath, fragmentPath;
+        unsigned int features;
+        std::vector<std::string> sources;
+    };
+    std::unordered_map<std::string, Variant> m_shaders;
+};
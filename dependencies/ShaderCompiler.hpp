@@ -0,0 +1,328 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ProgramCache.hpp"
+
+// asynchronous program builds: Shader submits compile and link without asking for
+// the result, poll() picks finished programs up once per frame. Until then a
+// Shader draws with a flat grey fallback and its uniform writes are replayed on
+// the real program once it links. KHR_parallel_shader_compile lets the driver work
+// on its own threads; without it poll() finishes one program per frame instead.
+// Hot reload builds a second program for an existing Shader the same way and only
+// redirects the Shader to it (uniform values copied over) once it links
+// --------------------------------------------------------------------------------
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+// a uniform write, given the location in whichever program is bound
+typedef std::function<void (int)> UniformSetter;
+
+class ShaderCompiler {
+public:
+    ShaderCompiler ()
+        : m_initialized(false), m_parallel(false), m_fallback(0), m_reported(true) {}
+
+    // once after gladLoadGLLoader and before the first Shader
+    void init (GLADloadproc load)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char * name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+                m_parallel = true;
+        }
+        if (m_parallel)
+        {
+            PFNMAXSHADERCOMPILERTHREADSPROC maxThreads = (PFNMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+            if (!maxThreads)
+                maxThreads = (PFNMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+            // let the driver pick the thread count
+            if (maxThreads)
+                maxThreads(0xFFFFFFFF);
+        }
+
+        // the only program built synchronously: mesh position in, flat grey out
+        const char * vertexCode =
+            "#version 330 core\n"
+            "layout (location = 0) in vec3 aPos;\n"
+            "uniform mat4 model;\n"
+            "uniform mat4 view;\n"
+            "uniform mat4 projection;\n"
+            "void main() { gl_Position = projection * view * model * vec4(aPos, 1.0); }\n";
+        const char * fragmentCode =
+            "#version 330 core\n"
+            "out vec4 FragColor;\n"
+            "void main() { FragColor = vec4(0.6, 0.6, 0.6, 1.0); }\n";
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER), fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(vertex, 1, &vertexCode, NULL);
+        glShaderSource(fragment, 1, &fragmentCode, NULL);
+        glCompileShader(vertex);
+        glCompileShader(fragment);
+        m_fallback = glCreateProgram();
+        glAttachShader(m_fallback, vertex);
+        glAttachShader(m_fallback, fragment);
+        glLinkProgram(m_fallback);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+
+        m_initialized = true;
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    // compile and link have been issued for program (a rebuild of `replaces` if set);
+    // without init() it is finished right away
+    void submit (unsigned int program, unsigned int vertex, unsigned int fragment, uint64_t cacheKey, double submitMs, unsigned int replaces = 0)
+    {
+        Pending pending;
+        pending.vertex = vertex;
+        pending.fragment = fragment;
+        pending.cacheKey = cacheKey;
+        pending.submitMs = submitMs;
+        pending.replaces = replaces;
+        pending.failed = false;
+        m_pending[program] = pending;
+        // the "all ready" line is about startup, hot reloads do not print it again
+        if (!replaces)
+            m_reported = false;
+        if (!m_initialized)
+            finish(program);
+    }
+
+    bool ready (unsigned int program) const
+    {
+        return m_pending.find(program) == m_pending.end();
+    }
+
+    // what a Shader should actually bind right now
+    unsigned int resolve (unsigned int program) const
+    {
+        if (!ready(program))
+            return m_fallback;
+        std::unordered_map<unsigned int, unsigned int>::const_iterator it = m_redirects.find(program);
+        return it != m_redirects.end() ? it->second : program;
+    }
+
+    // point the Shader `handle` at a linked rebuild, carrying its uniform values over
+    void replace (unsigned int handle, unsigned int program)
+    {
+        unsigned int previous = resolve(handle);
+        copyUniforms(previous, program);
+        // a fixed shader brings back a program that failed at startup
+        std::unordered_map<unsigned int, Pending>::iterator broken = m_pending.find(handle);
+        if (broken != m_pending.end() && broken->second.failed)
+            m_pending.erase(broken);
+        // the handle's own program stays alive, its name is what Shader copies hold on to
+        if (previous != handle && previous != m_fallback)
+            glDeleteProgram(previous);
+        m_redirects[handle] = program;
+    }
+
+    // keep the last write per uniform name for when the program links
+    void defer (unsigned int program, const std::string & name, const UniformSetter & set)
+    {
+        std::unordered_map<unsigned int, Pending>::iterator it = m_pending.find(program);
+        if (it != m_pending.end() && !it->second.failed)
+            it->second.uniforms[name] = set;
+    }
+
+    unsigned int pending () const
+    {
+        unsigned int count = 0;
+        for (const std::pair<const unsigned int, Pending> & entry : m_pending)
+            count += !entry.second.failed;
+        return count;
+    }
+
+    bool parallel () const
+    {
+        return m_parallel;
+    }
+
+    // once per frame, before anything is drawn
+    void poll ()
+    {
+        std::vector<unsigned int> done;
+        for (const std::pair<const unsigned int, Pending> & entry : m_pending)
+        {
+            if (entry.second.failed)
+                continue;
+            GLint complete = GL_TRUE;
+            if (m_parallel)
+                glGetProgramiv(entry.first, GL_COMPLETION_STATUS_KHR, &complete);
+            if (complete)
+                done.push_back(entry.first);
+            // the status query below blocks, one a frame keeps the window responsive
+            if (!m_parallel && !done.empty())
+                break;
+        }
+        for (unsigned int program : done)
+            finish(program);
+
+        if (pending() == 0 && !m_reported)
+        {
+            std::cout << "all shader programs ready after "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count() << " ms"
+                      << (m_parallel ? " (parallel compile)" : "") << std::endl;
+            programCache().report();
+            m_reported = true;
+        }
+    }
+
+private:
+    struct Pending {
+        unsigned int vertex, fragment;
+        uint64_t cacheKey;
+        double submitMs;
+        unsigned int replaces; // Shader handle a reload is for, 0 for a new program
+        bool failed;
+        std::unordered_map<std::string, UniformSetter> uniforms;
+    };
+
+    bool m_initialized, m_parallel;
+    unsigned int m_fallback;
+    bool m_reported;
+    std::chrono::steady_clock::time_point m_start;
+    std::unordered_map<unsigned int, Pending> m_pending;
+    std::unordered_map<unsigned int, unsigned int> m_redirects; // Shader handle -> reloaded program
+
+    // every active uniform of `to` that `from` has too, read back and written again
+    static void copyUniforms (unsigned int from, unsigned int to)
+    {
+        GLint current = 0, count = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(to);
+        glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            char name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(to, i, sizeof(name), NULL, &size, &type, name);
+            int source = glGetUniformLocation(from, name), target = glGetUniformLocation(to, name);
+            if (source < 0 || target < 0)
+                continue;
+            GLfloat f[16];
+            GLint n[4];
+            switch (type)
+            {
+            case GL_FLOAT:      glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+            case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+            case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+            case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+            case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+            case GL_INT_VEC2:   glGetUniformiv(from, source, n); glUniform2iv(target, 1, n); break;
+            case GL_INT_VEC3:   glGetUniformiv(from, source, n); glUniform3iv(target, 1, n); break;
+            case GL_INT_VEC4:   glGetUniformiv(from, source, n); glUniform4iv(target, 1, n); break;
+            case GL_INT:
+            case GL_BOOL:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW:
+            case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_BUFFER:
+            case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+                glGetUniformiv(from, source, n);
+                glUniform1i(target, n[0]);
+                break;
+            default:
+                break; // no other types in our shaders
+            }
+        }
+        glUseProgram(current);
+    }
+
+    // status checks, error logs and the binary cache entry: everything that waits on the driver
+    void finish (unsigned int program)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Pending & pending = m_pending[program];
+        int success;
+        char infoLog[512];
+        glGetShaderiv(pending.vertex, GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            glGetShaderInfoLog(pending.vertex, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
+            infoLog << std::endl;
+        };
+        glGetShaderiv(pending.fragment, GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            glGetShaderInfoLog(pending.fragment, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" <<
+            infoLog << std::endl;
+        };
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if(!success)
+        {
+            glGetProgramInfoLog(program, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" <<
+            infoLog << std::endl;
+        }
+        else
+            programCache().store(pending.cacheKey, program);
+        // delete shaders; they’re linked into our program and no longer necessary
+        glDeleteShader(pending.vertex);
+        glDeleteShader(pending.fragment);
+
+        if (pending.replaces)
+        {
+            // a failed reload keeps the program that is already on screen
+            if (success)
+                replace(pending.replaces, program);
+            else
+            {
+                std::cout << "WARNING::SHADER::RELOAD_FAILED keeping the previous program" << std::endl;
+                glDeleteProgram(program);
+            }
+            m_pending.erase(program);
+            return;
+        }
+
+        if (success)
+        {
+            // uniforms written while the fallback stood in
+            GLint current = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+            glUseProgram(program);
+            for (const std::pair<const std::string, UniformSetter> & uniform : pending.uniforms)
+                uniform.second(glGetUniformLocation(program, uniform.first.c_str()));
+            glUseProgram(current);
+        }
+
+        double ms = pending.submitMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        programCache().record(false, ms);
+        // a broken program keeps drawing with the fallback
+        if (success)
+            m_pending.erase(program);
+        else
+        {
+            pending.failed = true;
+            pending.uniforms.clear();
+        }
+    }
+};
+
+inline ShaderCompiler & shaderCompiler ()
+{
+    static ShaderCompiler compiler;
+    return compiler;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GLSL build step in front of glShaderSource: `#include "file"` (relative to the
+// including file, each file pulled in once) and permutation #defines inserted
+// right after #version. #line directives keep compiler messages pointing at the
+// original file: the source string number is the file's index in `files`
+// ------------------------------------------------------------------------------
+
+#include "EmbeddedAssets.hpp"
+
+// paths are asset names ("GLSLs/cube_vertex.glsl"), see EmbeddedAssets.hpp
+inline bool readShaderFile (const std::string & path, std::string & code)
+{
+    return readAsset(path, code);
+}
+
+// "#  version 330 core" -> "version 330 core"; empty for anything not a directive
+inline std::string shaderDirective (const std::string & line)
+{
+    size_t hash = line.find_first_not_of(" \t");
+    if (hash == std::string::npos || line[hash] != '#')
+        return std::string();
+    size_t name = line.find_first_not_of(" \t", hash + 1);
+    return name == std::string::npos ? std::string() : line.substr(name);
+}
+
+inline bool expandShaderFile (const std::string & path, const std::vector<std::string> & defines,
+                              std::vector<std::string> & files, std::string & out)
+{
+    std::string code;
+    if (!readShaderFile(path, code))
+    {
+        std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << path << std::endl;
+        return false;
+    }
+    int index = files.size();
+    files.push_back(path);
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    std::istringstream lines(code);
+    std::string line;
+    int number = 0;
+    if (index > 0)
+        out += "#line 1 " + std::to_string(index) + "\n";
+    while (std::getline(lines, line))
+    {
+        ++number;
+        std::string directive = shaderDirective(line);
+        if (directive.compare(0, 7, "include") == 0)
+        {
+            size_t open = directive.find('"'), close = directive.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ":" << number << std::endl;
+                return false;
+            }
+            std::string included = directory + directive.substr(open + 1, close - open - 1);
+            bool seen = false;
+            for (const std::string & file : files)
+                seen = seen || file == included;
+            if (!seen && !expandShaderFile(included, defines, files, out))
+                return false;
+            out += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+        }
+        else if (index == 0 && directive.compare(0, 7, "version") == 0)
+        {
+            out += line + "\n";
+            for (const std::string & define : defines)
+                out += "#define " + define + "\n";
+            out += "#line " + std::to_string(number + 1) + " 0\n";
+        }
+        else
+            out += line + "\n";
+    }
+    return true;
+}
+
+// the source handed to the compiler; false if the file or one of its includes is missing.
+// files (if given) collects every file read, the hot reload matches changes against it
+inline bool preprocessShader (const char * path, const std::vector<std::string> & defines, std::string & code,
+                              std::vector<std::string> * files = NULL)
+{
+    std::vector<std::string> read;
+    code.clear();
+    bool ok = expandShaderFile(path, defines, read, code);
+    if (files)
+        files->insert(files->end(), read.begin(), read.end());
+    return ok;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+
+#include "GpuTimer.hpp"
+#include "RenderTarget.hpp"
+#include "Shader.hpp"
+
+// omnidirectional shadow of the main (point) light: a depth cube map holding the
+// distance to the light over shadowFar, written by shadow_fragment.glsl and read
+// by shadowFactor in lighting.glsl. Static casters live in a cached cube that is
+// only redrawn when the light moves; every frame it is blitted into the sampled
+// cube and the dynamic casters are drawn on top
+// --------------------------------------------------------------------------------
+
+// texture unit the sampled cube is bound to, after the G-buffer's
+const int SHADOW_UNIT = 12;
+
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order: look direction, then up
+const glm::vec3 SHADOW_FACE_AXIS[6] = {
+    glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3( 0.0f,  1.0f,  0.0f),
+    glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f)
+};
+const glm::vec3 SHADOW_FACE_UP[6] = {
+    glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f,  0.0f,  1.0f),
+    glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f)
+};
+
+class ShadowMaps {
+public:
+    // static cube redraws and reuses, pass times of the last frame
+    unsigned int m_staticRenders, m_staticHits;
+    unsigned int m_dynamicDraws; // casters drawn into faces this frame
+    double m_cpuMs;
+    bool m_enabled;
+
+    ShadowMaps ()
+        : m_staticRenders(0), m_staticHits(0), m_dynamicDraws(0), m_cpuMs(0.0), m_enabled(true),
+          m_size(0), m_far(1.0f), m_staticValid(false), m_light(0.0f)
+    {
+        m_cubes[0] = m_cubes[1] = 0;
+        m_FBOs[0] = m_FBOs[1] = 0;
+    }
+
+    // needs a current GL context; `far` bounds both the casters and the receivers
+    void init (int size = 512, float far = 30.0f)
+    {
+        m_size = size;
+        m_far = far;
+        glGenTextures(2, m_cubes);
+        glGenFramebuffers(2, m_FBOs);
+        for (int i = 0; i < 2; ++i)
+        {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubes[i]);
+            for (int face = 0; face < 6; ++face)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                             GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            // hardware 2x2 PCF where the filter is honoured
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+            // depth only
+            glBindFramebuffer(GL_FRAMEBUFFER, m_FBOs[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, m_cubes[i], 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::SHADOW::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+        m_timer.init();
+    }
+
+    // hit rate of the static cache over every frame rendered so far
+    float hitRate () const
+    {
+        unsigned int frames = m_staticRenders + m_staticHits;
+        return frames ? (float)m_staticHits / frames : 0.0f;
+    }
+
+    double gpuMs () const
+    {
+        return m_timer.ms();
+    }
+
+    size_t bytes () const
+    {
+        return 2 * 6 * (size_t)m_size * m_size * 4;
+    }
+
+    // forget the static cube, for edits to the static casters themselves
+    void invalidate ()
+    {
+        m_staticValid = false;
+    }
+
+    // does a caster's bounding sphere reach into `face`; dynamic passes skip the rest
+    bool faceSees (int face, const glm::vec3 & center, float radius) const
+    {
+        glm::vec3 p = center - m_light;
+        if (glm::dot(p, p) > (m_far + radius) * (m_far + radius))
+            return false;
+        const glm::vec3 & axis = SHADOW_FACE_AXIS[face];
+        glm::vec3 u = SHADOW_FACE_UP[face], v = glm::cross(axis, u);
+        // the four side planes of the face's 90 degree pyramid
+        float reach = radius * 1.41421356f;
+        float along = glm::dot(p, axis), pu = glm::dot(p, u), pv = glm::dot(p, v);
+        return along + reach >= fabs(pu) && along + reach >= fabs(pv);
+    }
+
+    // drawFace(face, view, projection, dynamic) draws the static or the dynamic
+    // casters into one face with the matrices set on the shadow shaders; the caller
+    // restores its viewport afterwards
+    template <typename F>
+    void render (const glm::vec3 & light, F drawFace)
+    {
+        if (!m_enabled)
+            return;
+        auto start = std::chrono::high_resolution_clock::now();
+        m_timer.begin();
+        if (light != m_light)
+            m_staticValid = false;
+        m_light = light;
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, m_far);
+        glViewport(0, 0, m_size, m_size);
+
+        if (!m_staticValid)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_FBOs[0]);
+            for (int face = 0; face < 6; ++face)
+            {
+                attach(0, face);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawFace(face, faceView(face), projection, false);
+            }
+            m_staticValid = true;
+            m_staticRenders++;
+        }
+        else
+            m_staticHits++;
+
+        m_dynamicDraws = 0;
+        for (int face = 0; face < 6; ++face)
+        {
+            // static depth first, dynamic casters depth tested against it
+            attach(0, face);
+            attach(1, face);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBOs[0]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBOs[1]);
+            glBlitFramebuffer(0, 0, m_size, m_size, 0, 0, m_size, m_size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_FBOs[1]);
+            drawFace(face, faceView(face), projection, true);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+        m_timer.end();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        m_cpuMs = elapsed.count();
+    }
+
+    // the composited cube for a lit shader; shadowFar 0 switches the lookup off
+    void bind (const Shader & shader, int unit = SHADOW_UNIT) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubes[1]);
+        glActiveTexture(GL_TEXTURE0);
+        shader.use();
+        shader.setInt("shadowMap", unit);
+        shader.setVec3("shadowPosition", m_light);
+        shader.setFloat("shadowFar", m_enabled ? m_far : 0.0f);
+    }
+
+    // for shadow_fragment.glsl
+    void bindCaster (const Shader & shader) const
+    {
+        shader.use();
+        shader.setVec3("shadowPosition", m_light);
+        shader.setFloat("shadowFar", m_far);
+    }
+
+private:
+    unsigned int m_cubes[2]; // static cache, composited
+    unsigned int m_FBOs[2];
+    int m_size;
+    float m_far;
+    bool m_staticValid;
+    glm::vec3 m_light;
+    GpuTimer m_timer;
+
+    glm::mat4 faceView (int face) const
+    {
+        return glm::lookAt(m_light, m_light + SHADOW_FACE_AXIS[face], SHADOW_FACE_UP[face]);
+    }
+
+    void attach (int cube, int face)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FBOs[cube]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_cubes[cube], 0);
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "BlockCompression.hpp"
+#include "TextureCache.hpp"
+
+// every streamed texture lives in one GL_TEXTURE_2D_ARRAY: images are shelf packed
+// into fixed size layers as tiles with a wrapped border, so nodes with different
+// textures only differ in a layer index and a uv rectangle, never in a binding
+// ----------------------------------------------------------------------------------
+
+const int TEXTURE_ARRAY_SIZE = 1024;  // layer width and height
+const int TEXTURE_ARRAY_LAYERS = 4;
+const int TEXTURE_ARRAY_LEVELS = 5;   // 1024 down to 64; past that neighbouring tiles would bleed
+const int TEXTURE_TILE_GUTTER = 16;   // wrapped border, still one texel on the last level
+const int TEXTURE_TILE_ALIGN = 64;    // tile sizes and positions, keeps 4x4 blocks aligned on every level
+
+// where a texture sits: rect.xy is the offset and rect.zw the size in layer uv
+struct TextureSlot {
+    float layer;
+    glm::vec4 rect;
+
+    TextureSlot ()
+        : layer(0.0f), rect(0.0f, 0.0f, 1.0f, 1.0f) {}
+};
+
+// array format: BC3 holds RGB and RGBA alike, plain RGBA8 without S3TC or compression
+inline GLenum textureArrayFormat ()
+{
+    const TextureCompressionSettings & compression = textureCompression();
+    return compression.enabled && compression.s3tcSupported ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+}
+
+// shelf packer over the layers, first fit; released regions are handed out again
+// to tiles that fit inside them
+// -------------------------------------------------------------------------------
+class TextureAtlas {
+public:
+    TextureAtlas ()
+        : m_layers(TEXTURE_ARRAY_LAYERS) {}
+
+    bool allocate (int width, int height, int & layer, int & x, int & y)
+    {
+        for (unsigned int i = 0; i < m_free.size(); ++i)
+        {
+            Region & region = m_free[i];
+            if (width > region.width || height > region.height)
+                continue;
+            layer = region.layer;
+            x = region.x;
+            y = region.y;
+            // the rest of the region stays free, to the right of the tile
+            region.x += width;
+            region.width -= width;
+            if (region.width == 0)
+                m_free.erase(m_free.begin() + i);
+            return true;
+        }
+        for (layer = 0; layer < (int)m_layers.size(); ++layer)
+        {
+            Layer & shelves = m_layers[layer];
+            for (Shelf & shelf : shelves.shelves)
+            {
+                if (height <= shelf.height && shelf.used + width <= TEXTURE_ARRAY_SIZE)
+                {
+                    x = shelf.used;
+                    y = shelf.y;
+                    shelf.used += width;
+                    return true;
+                }
+            }
+            if (shelves.top + height <= TEXTURE_ARRAY_SIZE && width <= TEXTURE_ARRAY_SIZE)
+            {
+                Shelf shelf = { shelves.top, height, width };
+                shelves.shelves.push_back(shelf);
+                shelves.top += height;
+                x = 0;
+                y = shelf.y;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a region from allocate() that is no longer sampled; the end of a shelf
+    // shrinks it, anything else goes on the free list
+    void release (int layer, int x, int y, int width, int height)
+    {
+        for (Shelf & shelf : m_layers[layer].shelves)
+        {
+            if (shelf.y == y && x + width == shelf.used)
+            {
+                shelf.used = x;
+                return;
+            }
+        }
+        Region region = { layer, x, y, width, height };
+        m_free.push_back(region);
+    }
+
+private:
+    struct Shelf {
+        int y, height, used;
+    };
+    struct Layer {
+        std::vector<Shelf> shelves;
+        int top = 0;
+    };
+    struct Region {
+        int layer, x, y, width, height;
+    };
+    std::vector<Layer> m_layers;
+    std::vector<Region> m_free;
+};
+
+inline int alignTile (int size)
+{
+    return (size + TEXTURE_TILE_ALIGN - 1) / TEXTURE_TILE_ALIGN * TEXTURE_TILE_ALIGN;
+}
+
+// bake a tile: the linear light mip chain of the source, each level surrounded by a
+// wrapped border and padded out to the tile size, then encoded in the array format;
+// images too large for a layer start at the first level that fits
+// ---------------------------------------------------------------------------------
+inline void buildArrayTile (const unsigned char * pixels, int width, int height, int channels, TextureImage & tile)
+{
+    TextureImage chain;
+    buildMipChain(pixels, width, height, channels, chain);
+
+    unsigned int skip = 0;
+    while (skip + 1 < chain.levels.size()
+           && (chain.levels[skip].width + 2 * TEXTURE_TILE_GUTTER > TEXTURE_ARRAY_SIZE
+               || chain.levels[skip].height + 2 * TEXTURE_TILE_GUTTER > TEXTURE_ARRAY_SIZE))
+        ++skip;
+
+    const TextureCompressionSettings & compression = textureCompression();
+    GLenum format = textureArrayFormat();
+    int tileWidth = alignTile(chain.levels[skip].width + 2 * TEXTURE_TILE_GUTTER);
+    int tileHeight = alignTile(chain.levels[skip].height + 2 * TEXTURE_TILE_GUTTER);
+    unsigned int threads = compression.threads ? compression.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    tile.internalFormat = format;
+    tile.format = GL_RGBA;
+    tile.type = GL_UNSIGNED_BYTE;
+    tile.compressed = format != GL_RGBA8;
+    tile.channels = 4;
+    tile.gutter = TEXTURE_TILE_GUTTER;
+    tile.contentWidth = chain.levels[skip].width;
+    tile.contentHeight = chain.levels[skip].height;
+    tile.levels.clear();
+    tile.storage.clear();
+
+    std::vector<unsigned char> rgba;
+    for (int k = 0; k < TEXTURE_ARRAY_LEVELS; ++k)
+    {
+        const TextureLevel & source = chain.levels[std::min(skip + k, (unsigned int)chain.levels.size() - 1)];
+        const unsigned char * src = chain.levelData(std::min(skip + k, (unsigned int)chain.levels.size() - 1));
+        int levelWidth = tileWidth >> k, levelHeight = tileHeight >> k, gutter = TEXTURE_TILE_GUTTER >> k;
+
+        // wrap the source over the whole tile so the border repeats it
+        rgba.resize((size_t)levelWidth * levelHeight * 4);
+        for (int y = 0; y < levelHeight; ++y)
+        {
+            int sy = ((y - gutter) % source.height + source.height) % source.height;
+            for (int x = 0; x < levelWidth; ++x)
+            {
+                int sx = ((x - gutter) % source.width + source.width) % source.width;
+                const unsigned char * texel = src + ((size_t)sy * source.width + sx) * channels;
+                unsigned char * out = &rgba[((size_t)y * levelWidth + x) * 4];
+                out[0] = texel[0];
+                out[1] = channels > 1 ? texel[1] : texel[0];
+                out[2] = channels > 2 ? texel[2] : texel[0];
+                out[3] = channels == 4 ? texel[3] : (channels == 2 ? texel[1] : 255);
+            }
+        }
+
+        TextureLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.offset = tile.storage.size();
+        level.size = tile.compressed ? compressedLevelSize(format, levelWidth, levelHeight) : rgba.size();
+        tile.storage.resize(level.offset + level.size);
+        if (tile.compressed)
+            compressLevel(&rgba[0], levelWidth, levelHeight, 4, format, compression.quality, threads, &tile.storage[level.offset]);
+        else
+            memcpy(&tile.storage[level.offset], &rgba[0], level.size);
+        tile.levels.push_back(level);
+    }
+}
+
+// cached array tile for a source image
+inline bool loadTextureTile (const char * path, TextureImage & tile)
+{
+    uint32_t bakeKey = textureArrayFormat() ^ textureCompression().quality << 16;
+    return loadBakedImage(path, ".tile", bakeKey, buildArrayTile, tile);
+}
+
+// uv rectangle of a tile placed at (x, y) on `layer`
+inline TextureSlot textureTileSlot (const TextureImage & tile, int layer, int x, int y)
+{
+    TextureSlot slot;
+    float size = TEXTURE_ARRAY_SIZE;
+    slot.layer = layer;
+    slot.rect = glm::vec4((x + tile.gutter) / size, (y + tile.gutter) / size, tile.contentWidth / size, tile.contentHeight / size);
+    return slot;
+}
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "AssetArchive.hpp"
+#include "BlockCompression.hpp"
+#include "MappedFile.hpp"
+#include "MipGen.hpp"
+#include "PNM.hpp"
+
+// pre-baked textures: the whole mip chain in its final GL format, stored next to
+// the sources under TEXTURE_CACHE_DIR and rebuilt whenever the source hash changes
+// --------------------------------------------------------------------------------
+
+#define TEXTURE_CACHE_DIR "../cache/"
+// bump whenever the baked pixels would differ for the same source
+const uint32_t TEXTURE_CACHE_VERSION = 4;
+// largest level side a cache file may claim, far past anything GL_MAX_TEXTURE_SIZE allows
+const uint32_t TEXTURE_CACHE_MAX_SIZE = 1 << 16;
+
+struct TextureLevel {
+    int width, height;
+    size_t offset, size; // into TextureImage::base()
+};
+
+// a complete mip chain, owned in memory or mapped straight from the cache file
+struct TextureImage {
+    GLenum internalFormat, format, type;
+    bool compressed;
+    int channels;
+    // the source image inside level 0, past a border of `gutter` texels (array tiles only)
+    int gutter, contentWidth, contentHeight;
+    std::vector<TextureLevel> levels;
+    std::vector<unsigned char> storage;
+    MappedFile mapping;
+
+    TextureImage ()
+        : internalFormat(0), format(0), type(GL_UNSIGNED_BYTE), compressed(false), channels(0),
+          gutter(0), contentWidth(0), contentHeight(0) {}
+
+    const unsigned char * base () const
+    {
+        if (mapping.valid())
+            return mapping.data();
+        return storage.empty() ? NULL : &storage[0];
+    }
+
+    const unsigned char * levelData (unsigned int level) const
+    {
+        return base() + levels[level].offset;
+    }
+
+    size_t bytes () const
+    {
+        size_t total = 0;
+        for (const TextureLevel & level : levels)
+            total += level.size;
+        return total;
+    }
+};
+
+// on-disk layout: header, one TextureCacheLevel per level, 16 byte aligned payloads
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t internalFormat, format, type, compressed;
+    uint32_t channels, levelCount;
+    uint32_t gutter, contentWidth, contentHeight, reserved;
+};
+
+struct TextureCacheLevel {
+    uint32_t width, height;
+    uint64_t offset, size;
+};
+
+// suffix tells apart different bakes of the same source
+inline std::string textureCachePath (const char * source, const char * suffix = "")
+{
+    std::string name(source);
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos)
+        name = name.substr(slash + 1);
+    return std::string(TEXTURE_CACHE_DIR) + name + suffix + ".gtex";
+}
+
+inline void textureFormats (int channels, GLenum & internalFormat, GLenum & format)
+{
+    if (channels == 1)
+    {
+        internalFormat = GL_R8;
+        format = GL_RED;
+    }
+    else if (channels == 2)
+    {
+        internalFormat = GL_RG8;
+        format = GL_RG;
+    }
+    else if (channels == 3)
+    {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+    }
+    else
+    {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+    }
+}
+
+// filter used when baking; changing it needs a TEXTURE_CACHE_VERSION bump
+inline MipOptions textureMipOptions ()
+{
+    MipOptions options;
+    options.filter = MIP_KAISER;
+    options.srgb = true;
+    return options;
+}
+
+// full chain down to 1x1 from the CPU generator, every level tightly packed
+// -------------------------------------------------------------------------
+inline void buildMipChain (const unsigned char * pixels, int width, int height, int channels, TextureImage & image)
+{
+    image.channels = channels;
+    image.compressed = false;
+    image.type = GL_UNSIGNED_BYTE;
+    image.gutter = 0;
+    image.contentWidth = width;
+    image.contentHeight = height;
+    textureFormats(channels, image.internalFormat, image.format);
+    image.levels.clear();
+    image.storage.clear();
+
+    std::vector<MipLevelData> mips;
+    generateMips(pixels, width, height, channels, textureMipOptions(), mips);
+
+    TextureLevel level;
+    level.width = width;
+    level.height = height;
+    level.offset = 0;
+    level.size = (size_t)width * height * channels;
+    size_t total = level.size;
+    for (const MipLevelData & mip : mips)
+        total += mip.pixels.size();
+    image.storage.reserve(total);
+    image.storage.assign(pixels, pixels + level.size);
+    image.levels.push_back(level);
+
+    for (const MipLevelData & mip : mips)
+    {
+        level.width = mip.width;
+        level.height = mip.height;
+        level.offset = image.storage.size();
+        level.size = mip.pixels.size();
+        image.storage.insert(image.storage.end(), mip.pixels.begin(), mip.pixels.end());
+        image.levels.push_back(level);
+    }
+}
+
+// replace every level with its BC encoding (format picked from the channel count)
+inline void compressTextureImage (TextureImage & image, const TextureCompressionSettings & settings)
+{
+    GLenum format = blockFormat(image.channels);
+    std::vector<unsigned char> storage;
+    std::vector<TextureLevel> levels = image.levels;
+    size_t total = 0;
+    for (TextureLevel & level : levels)
+    {
+        level.offset = total;
+        level.size = compressedLevelSize(format, level.width, level.height);
+        total += level.size;
+    }
+    storage.resize(total);
+
+    unsigned int threads = settings.threads ? settings.threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < levels.size(); ++i)
+        compressLevel(image.levelData(i), levels[i].width, levels[i].height, image.channels, format,
+                      settings.quality, threads, &storage[levels[i].offset]);
+
+    image.internalFormat = format;
+    image.compressed = true;
+    image.levels.swap(levels);
+    image.storage.swap(storage);
+    image.mapping.close();
+}
+
+// fallback when the driver can't sample the block format: decode back to plain texels
+inline void decompressTextureImage (TextureImage & image)
+{
+    std::vector<unsigned char> storage;
+    std::vector<TextureLevel> levels = image.levels;
+    size_t total = 0;
+    for (TextureLevel & level : levels)
+    {
+        level.offset = total;
+        level.size = (size_t)level.width * level.height * image.channels;
+        total += level.size;
+    }
+    storage.resize(total);
+    for (unsigned int i = 0; i < levels.size(); ++i)
+        decompressLevel(image.levelData(i), levels[i].width, levels[i].height, image.internalFormat, image.channels, &storage[levels[i].offset]);
+
+    textureFormats(image.channels, image.internalFormat, image.format);
+    image.compressed = false;
+    image.levels.swap(levels);
+    image.storage.swap(storage);
+    image.mapping.close();
+}
+
+// write to a temporary name first so a crash never leaves a torn cache file behind
+inline bool writeTextureCache (const std::string & path, uint64_t sourceHash, const TextureImage & image)
+{
+    mkdir(TEXTURE_CACHE_DIR, 0755);
+    std::string temp = path + ".tmp";
+    FILE * file = fopen(temp.c_str(), "wb");
+    if (!file)
+        return false;
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GTEX", 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.internalFormat = image.internalFormat;
+    header.format = image.format;
+    header.type = image.type;
+    header.compressed = image.compressed;
+    header.channels = image.channels;
+    header.levelCount = image.levels.size();
+    header.gutter = image.gutter;
+    header.contentWidth = image.contentWidth;
+    header.contentHeight = image.contentHeight;
+
+    std::vector<TextureCacheLevel> table(image.levels.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(TextureCacheLevel);
+    for (unsigned int i = 0; i < table.size(); ++i)
+    {
+        offset = (offset + 15) & ~(uint64_t)15;
+        table[i].width = image.levels[i].width;
+        table[i].height = image.levels[i].height;
+        table[i].offset = offset;
+        table[i].size = image.levels[i].size;
+        offset += table[i].size;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(&table[0], sizeof(TextureCacheLevel), table.size(), file) == table.size();
+    const unsigned char zeros[16] = { 0 };
+    uint64_t position = sizeof(header) + table.size() * sizeof(TextureCacheLevel);
+    for (unsigned int i = 0; ok && i < table.size(); ++i)
+    {
+        ok = fwrite(zeros, 1, table[i].offset - position, file) == table[i].offset - position;
+        ok = ok && fwrite(image.levelData(i), 1, table[i].size, file) == table[i].size;
+        position = table[i].offset + table[i].size;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(temp.c_str());
+    return ok;
+}
+
+// map a cache file; fails (and the caller rebuilds) on any mismatch with the source
+inline bool readTextureCache (const std::string & path, uint64_t sourceHash, TextureImage & image)
+{
+    MappedFile mapping(path.c_str());
+    if (!mapping.valid() || mapping.size() < sizeof(TextureCacheHeader))
+        return false;
+
+    TextureCacheHeader header;
+    memcpy(&header, mapping.data(), sizeof(header));
+    size_t tableEnd = sizeof(header) + (size_t)header.levelCount * sizeof(TextureCacheLevel);
+    if (memcmp(header.magic, "GTEX", 4) != 0 || header.version != TEXTURE_CACHE_VERSION
+        || header.sourceHash != sourceHash || header.levelCount == 0 || tableEnd > mapping.size())
+        return false;
+
+    // a stale or corrupt file must not send the uploads past the mapping: formats are
+    // ones the bakes produce and every level holds exactly its texels
+    bool compressed = header.compressed != 0;
+    if (compressed ? strcmp(blockFormatName(header.internalFormat), "raw") == 0
+                   : header.type != GL_UNSIGNED_BYTE || header.channels < 1 || header.channels > 4)
+        return false;
+
+    image.levels.clear();
+    for (unsigned int i = 0; i < header.levelCount; ++i)
+    {
+        TextureCacheLevel entry;
+        memcpy(&entry, mapping.data() + sizeof(header) + i * sizeof(TextureCacheLevel), sizeof(entry));
+        if (entry.width < 1 || entry.height < 1 || entry.width > TEXTURE_CACHE_MAX_SIZE || entry.height > TEXTURE_CACHE_MAX_SIZE)
+            return false;
+        size_t expected = compressed ? compressedLevelSize(header.internalFormat, entry.width, entry.height)
+                                     : (size_t)entry.width * entry.height * header.channels;
+        if (entry.size != expected || entry.offset > mapping.size() || entry.size > mapping.size() - entry.offset)
+            return false;
+        TextureLevel level;
+        level.width = entry.width;
+        level.height = entry.height;
+        level.offset = entry.offset;
+        level.size = entry.size;
+        image.levels.push_back(level);
+    }
+
+    image.internalFormat = header.internalFormat;
+    image.format = header.format;
+    image.type = header.type;
+    image.compressed = header.compressed != 0;
+    image.channels = header.channels;
+    image.gutter = header.gutter;
+    image.contentWidth = header.contentWidth;
+    image.contentHeight = header.contentHeight;
+    image.storage.clear();
+    image.mapping = std::move(mapping);
+    return true;
+}
+
+// cached bake of a source image: mapped on a hit, otherwise the source is decoded,
+// handed to bake(pixels, width, height, channels, image) and the result stored;
+// bakeKey must change whenever bake would produce different bytes
+// ---------------------------------------------------------------------------------
+template <typename Bake>
+inline bool loadBakedImage (const char * path, const char * suffix, uint32_t bakeKey, Bake bake, TextureImage & image)
+{
+    // packed in the asset archive or a loose file, mapped either way
+    AssetData source;
+    if (!openAsset(path, source))
+        return false;
+
+    uint64_t sourceHash = hashBytes(source.data, source.size);
+    sourceHash = hashBytes((const unsigned char *)&bakeKey, sizeof(bakeKey), sourceHash);
+    std::string cachePath = textureCachePath(path, suffix);
+    if (!readTextureCache(cachePath, sourceHash, image))
+    {
+        // netpbm files by extension (stbi can't read ASCII P3), everything else through stb_image
+        if (isPNMPath(path))
+        {
+            PNMImage pnm;
+            if (!decodePNM(source.data, source.size, pnm))
+                return false;
+            bake(pnm.pixels, pnm.width, pnm.height, pnm.channels, image);
+        }
+        else
+        {
+            int width, height, nrComponents;
+            unsigned char * data = stbi_load_from_memory(source.data, source.size, &width, &height, &nrComponents, 0);
+            if (!data)
+                return false;
+            bake(data, width, height, nrComponents, image);
+            stbi_image_free(data);
+        }
+
+        if (!writeTextureCache(cachePath, sourceHash, image))
+            std::cout << "WARNING::TEXTURE_CACHE::WRITE_FAILED " << cachePath << std::endl;
+    }
+
+    if (image.compressed && !blockFormatSupported(image.internalFormat))
+        decompressTextureImage(image);
+    return true;
+}
+
+// plain 2D mip chain, block compressed according to textureCompression()
+inline bool loadTextureImage (const char * path, TextureImage & image)
+{
+    const TextureCompressionSettings & compression = textureCompression();
+    uint32_t bakeKey = compression.enabled ? 1 + compression.quality : 0;
+    return loadBakedImage(path, "", bakeKey, [&](const unsigned char * pixels, int width, int height, int channels, TextureImage & baked) {
+        buildMipChain(pixels, width, height, channels, baked);
+        if (compression.enabled)
+            compressTextureImage(baked, compression);
+    }, image);
+}
+
+// allocate and fill every level of the currently bound GL_TEXTURE_2D
+inline void uploadTextureImage (const TextureImage & image)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int i = 0; i < image.levels.size(); ++i)
+    {
+        const TextureLevel & level = image.levels[i];
+        if (image.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, level.size, image.levelData(i));
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, level.width, level.height, 0, image.format, image.type, image.levelData(i));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+}
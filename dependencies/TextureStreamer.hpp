@@ -0,0 +1,411 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TextureArray.hpp"
+#include "TextureCache.hpp"
+
+// GPU footprint of one resident texture, for the stats window
+struct TextureStats {
+    std::string path;
+    GLenum internalFormat;
+    int width, height;
+    int layer;
+    int tileWidth, tileHeight; // space taken in the layer
+    unsigned int levels;
+    size_t bytes;    // the tile as stored on the GPU, border and padding included
+    size_t rawBytes; // the source mip chain as uncompressed 8 bit texels
+};
+
+// decodes (or maps pre-baked) tiles on worker threads, packs them into one texture
+// array and uploads them through pixel buffer objects a bounded slice per frame;
+// a grey placeholder tile is handed out meanwhile. reload() re-decodes a resident
+// texture in the background and swaps it in whole during a later update()
+// ------------------------------------------------------------------------
+class TextureStreamer {
+public:
+    // per frame numbers for the stats window
+    unsigned int m_bytesUploaded;
+    unsigned int m_pending;
+
+    TextureStreamer (unsigned int workers = 2, unsigned int uploadBudget = 1 << 20)
+        : m_bytesUploaded(0),
+          m_pending(0),
+          m_array(0),
+          m_format(GL_RGBA8),
+          m_budget(uploadBudget),
+          m_nextPBO(0),
+          m_quit(false)
+    {
+        m_PBOs[0] = m_PBOs[1] = 0;
+        for (unsigned int i = 0; i < workers; ++i)
+            m_workers.push_back(std::thread(&TextureStreamer::decodeLoop, this));
+    }
+
+    ~TextureStreamer ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (std::thread & worker : m_workers)
+            worker.join();
+    }
+
+    // needs a current GL context
+    void init ()
+    {
+        // the decode workers pick block formats (or the software fallback) from this
+        queryTextureCompression();
+        m_format = textureArrayFormat();
+        bool compressed = m_format != GL_RGBA8;
+
+        glGenTextures(1, &m_array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_array);
+        for (int i = 0; i < TEXTURE_ARRAY_LEVELS; ++i)
+        {
+            int size = TEXTURE_ARRAY_SIZE >> i;
+            if (compressed)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, m_format, size, size, TEXTURE_ARRAY_LAYERS, 0,
+                                       compressedLevelSize(m_format, size, size) * TEXTURE_ARRAY_LAYERS, NULL);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, i, m_format, size, size, TEXTURE_ARRAY_LAYERS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, TEXTURE_ARRAY_LEVELS - 1);
+        // tiles repeat through their border, sampling never leaves the layer
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // mid grey tile until the real image is resident
+        TextureImage grey;
+        std::vector<unsigned char> pixels(TEXTURE_TILE_ALIGN * TEXTURE_TILE_ALIGN * 4, 128);
+        buildArrayTile(&pixels[0], TEXTURE_TILE_ALIGN - 2 * TEXTURE_TILE_GUTTER, TEXTURE_TILE_ALIGN - 2 * TEXTURE_TILE_GUTTER, 4, grey);
+        int layer, x, y;
+        m_atlas.allocate(grey.levels[0].width, grey.levels[0].height, layer, x, y);
+        m_placeholder = textureTileSlot(grey, layer, x, y);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (unsigned int i = 0; i < grey.levels.size(); ++i)
+            uploadTileRows(grey, i, layer, x, y, 0, grey.levels[i].height, grey.levelData(i), grey.levels[i].size);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // two staging buffers, so filling one never waits on the copy out of the other
+        glGenBuffers(2, m_PBOs);
+        for (unsigned int i = 0; i < 2; ++i)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBOs[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_budget, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // queue a file for decoding, returns a handle for slot()
+    unsigned int request (const char * path)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.emplace_back();
+        m_entries.back().path = path;
+        unsigned int handle = m_entries.size() - 1;
+        m_decodeQueue.push_back(handle);
+        m_wake.notify_one();
+        return handle;
+    }
+
+    // hot reload: every texture loaded from path decodes again; the old tile stays
+    // on screen until the new one is complete and for good if the new one fails
+    unsigned int reload (const std::string & path)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        unsigned int count = 0;
+        for (unsigned int handle = 0; handle < m_entries.size(); ++handle)
+        {
+            Entry & entry = m_entries[handle];
+            if (entry.path != path || (entry.state != RESIDENT && entry.state != FAILED))
+                continue;
+            if (entry.state == FAILED)
+                entry.state = QUEUED;
+            m_decodeQueue.push_back(handle);
+            count++;
+        }
+        if (count)
+            m_wake.notify_all();
+        return count;
+    }
+
+    // the array every slot refers to, bind it once as GL_TEXTURE_2D_ARRAY
+    unsigned int texture () const
+    {
+        return m_array;
+    }
+
+    // layer and uv rectangle for a handle: the placeholder until every row is uploaded
+    // (or for a negative handle)
+    TextureSlot slot (int handle) const
+    {
+        if (handle < 0)
+            return m_placeholder;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Entry & entry = m_entries[handle];
+        return entry.state == RESIDENT ? entry.slot : m_placeholder;
+    }
+
+    bool resident (unsigned int handle) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries[handle].state == RESIDENT;
+    }
+
+    std::vector<TextureStats> stats () const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<TextureStats> resident;
+        for (const Entry & entry : m_entries)
+            if (entry.state == RESIDENT)
+                resident.push_back(entry.stats);
+        return resident;
+    }
+
+    // call once per frame on the GL thread: uploads at most uploadBudget bytes
+    void update ()
+    {
+        m_bytesUploaded = 0;
+        m_pending = 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Entry & entry : m_entries)
+        {
+            if (entry.state == RESIDENT && entry.reloaded)
+                swapReloaded(entry);
+            if (entry.state == RESIDENT || entry.state == FAILED)
+                continue;
+            m_pending++;
+            if (entry.state != DECODED || m_bytesUploaded >= m_budget)
+                continue;
+
+            // several slices per texture if the budget allows, one level at a time
+            while (entry.level < entry.image.levels.size() && m_bytesUploaded < m_budget)
+                uploadSlice(entry);
+            if (entry.level == entry.image.levels.size())
+            {
+                // the mip chain came pre-baked, nothing left for glGenerateMipmap
+                recordStats(entry);
+                entry.image = TextureImage();
+                entry.state = RESIDENT;
+                m_pending--;
+            }
+        }
+    }
+
+private:
+    enum State { QUEUED, DECODED, RESIDENT, FAILED };
+
+    struct Entry {
+        std::string path;
+        State state = QUEUED;
+        TextureImage image;      // the baked tile
+        int layer = 0, x = 0, y = 0;
+        int width = 0, height = 0; // the atlas region, a reloaded tile may use less of it
+        TextureSlot slot;
+        unsigned int level = 0;  // level being uploaded
+        int rowsUploaded = 0;    // rows (block rows if compressed) of that level already copied
+        TextureStats stats;
+        bool reloaded = false;   // `image` holds a re-decoded tile for a resident texture
+    };
+
+    // std::deque keeps references stable while request() appends
+    std::deque<Entry> m_entries;
+    std::deque<unsigned int> m_decodeQueue;
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+
+    TextureAtlas m_atlas;
+    TextureSlot m_placeholder;
+    unsigned int m_array;
+    GLenum m_format;
+    unsigned int m_PBOs[2];
+    unsigned int m_budget;
+    unsigned int m_nextPBO;
+    bool m_quit;
+
+    void decodeLoop ()
+    {
+        for (;;)
+        {
+            unsigned int handle;
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_quit || !m_decodeQueue.empty(); });
+                if (m_quit)
+                    return;
+                handle = m_decodeQueue.front();
+                m_decodeQueue.pop_front();
+                path = m_entries[handle].path;
+            }
+
+            TextureImage image;
+            bool loaded = loadTextureTile(path.c_str(), image);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry & entry = m_entries[handle];
+            if (entry.state == RESIDENT)
+            {
+                // a reload: placed and uploaded by update(), the old tile stays meanwhile
+                if (loaded)
+                {
+                    entry.image = std::move(image);
+                    entry.reloaded = true;
+                }
+                else
+                    std::cout << "WARNING::TEXTURE::RELOAD_FAILED keeping the previous image " << path << std::endl;
+            }
+            else if (!loaded)
+            {
+                std::cout << "Texture failed to load at path: " << path << std::endl;
+                entry.state = FAILED;
+            }
+            else if (!m_atlas.allocate(image.levels[0].width, image.levels[0].height, entry.layer, entry.x, entry.y))
+            {
+                std::cout << "ERROR::TEXTURE_ARRAY::FULL " << path << std::endl;
+                entry.state = FAILED;
+            }
+            else
+            {
+                entry.width = image.levels[0].width;
+                entry.height = image.levels[0].height;
+                entry.slot = textureTileSlot(image, entry.layer, entry.x, entry.y);
+                entry.image = std::move(image);
+                entry.state = DECODED;
+            }
+        }
+    }
+
+    // upload a reloaded tile in one go, so no frame ever samples a half written one; it
+    // reuses the old region when the tile fits in it, otherwise takes a new one and
+    // gives the old one back
+    void swapReloaded (Entry & entry)
+    {
+        entry.reloaded = false;
+        const TextureImage & image = entry.image;
+        int layer = entry.layer, x = entry.x, y = entry.y;
+        if (image.levels[0].width > entry.width || image.levels[0].height > entry.height)
+        {
+            if (!m_atlas.allocate(image.levels[0].width, image.levels[0].height, layer, x, y))
+            {
+                std::cout << "ERROR::TEXTURE_ARRAY::FULL " << entry.path << std::endl;
+                entry.image = TextureImage();
+                return;
+            }
+            // the draws already issued this frame read the old region before the upload
+            m_atlas.release(entry.layer, entry.x, entry.y, entry.width, entry.height);
+            entry.width = image.levels[0].width;
+            entry.height = image.levels[0].height;
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (unsigned int i = 0; i < image.levels.size(); ++i)
+        {
+            int rowCount = image.compressed ? (image.levels[i].height + 3) / 4 : image.levels[i].height;
+            uploadTileRows(image, i, layer, x, y, 0, rowCount, image.levelData(i), image.levels[i].size);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        m_bytesUploaded += image.bytes();
+
+        entry.layer = layer;
+        entry.x = x;
+        entry.y = y;
+        entry.slot = textureTileSlot(image, layer, x, y);
+        recordStats(entry);
+        entry.image = TextureImage();
+    }
+
+    void recordStats (Entry & entry)
+    {
+        const TextureImage & image = entry.image;
+        TextureStats & stats = entry.stats;
+        stats.path = entry.path;
+        stats.internalFormat = image.internalFormat;
+        stats.width = image.contentWidth;
+        stats.height = image.contentHeight;
+        stats.layer = entry.layer;
+        stats.levels = image.levels.size();
+        stats.tileWidth = image.levels[0].width;
+        stats.tileHeight = image.levels[0].height;
+        stats.bytes = image.bytes();
+        stats.rawBytes = 0;
+        for (unsigned int i = 0; i < image.levels.size(); ++i)
+            stats.rawBytes += (size_t)(image.contentWidth >> i) * (image.contentHeight >> i) * 4;
+    }
+
+    // copy rows [first, first + count) of one tile level into the array, from client
+    // memory or (with data as an offset) from the bound unpack buffer
+    void uploadTileRows (const TextureImage & tile, unsigned int level, int layer, int x, int y,
+                         int first, int count, const void * data, unsigned int bytes)
+    {
+        const TextureLevel & size = tile.levels[level];
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_array);
+        if (tile.compressed)
+        {
+            // rows are rows of 4x4 blocks, the last one may cover fewer texel rows
+            int top = first * 4;
+            int height = std::min(count * 4, size.height - top);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x >> level, (y >> level) + top, layer,
+                                      size.width, height, 1, tile.internalFormat, bytes, data);
+        }
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x >> level, (y >> level) + first, layer,
+                            size.width, count, 1, tile.format, tile.type, data);
+    }
+
+    // copy as many whole rows of the current level as the remaining budget allows into the next PBO;
+    // compressed levels go a row of 4x4 blocks at a time
+    void uploadSlice (Entry & entry)
+    {
+        const TextureImage & image = entry.image;
+        const TextureLevel & level = image.levels[entry.level];
+        int rowCount = image.compressed ? (level.height + 3) / 4 : level.height;
+        unsigned int rowBytes = level.size / rowCount;
+
+        unsigned int rows = std::min((m_budget - m_bytesUploaded) / rowBytes, (unsigned int)(rowCount - entry.rowsUploaded));
+        // always make progress, even if a single row is larger than the budget
+        rows = std::max(1u, rows);
+        unsigned int bytes = rows * rowBytes;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBOs[m_nextPBO]);
+        // orphan: the driver hands out fresh storage if the previous copy is still in flight
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, std::max(bytes, m_budget), NULL, GL_STREAM_DRAW);
+        void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped)
+        {
+            memcpy(mapped, image.levelData(entry.level) + (size_t)entry.rowsUploaded * rowBytes, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            uploadTileRows(image, entry.level, entry.layer, entry.x, entry.y, entry.rowsUploaded, rows, (void*)0, bytes);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            entry.rowsUploaded += rows;
+            if (entry.rowsUploaded == rowCount)
+            {
+                entry.level++;
+                entry.rowsUploaded = 0;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        m_nextPBO = 1 - m_nextPBO;
+        m_bytesUploaded += bytes;
+    }
+};
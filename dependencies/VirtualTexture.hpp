@@ -0,0 +1,544 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "MipGen.hpp"
+#include "RenderTarget.hpp"
+#include "Shader.hpp"
+#include "TextureCache.hpp"
+
+// virtual texturing: the source map is baked once into fixed size pages per mip
+// level (a tiled .vtex file in the texture cache), only the pages a feedback pass
+// asks for are read on a worker thread and kept in a physical page cache with LRU
+// eviction; an indirection texture maps every virtual page to its cache slot
+// ------------------------------------------------------------------------------
+
+const int VIRTUAL_PAGE_SIZE = 128;   // texels of a page
+const int VIRTUAL_PAGE_BORDER = 4;   // border for bilinear filtering across pages
+const int VIRTUAL_TILE_SIZE = VIRTUAL_PAGE_SIZE + 2 * VIRTUAL_PAGE_BORDER;
+const int VIRTUAL_FEEDBACK_SCALE = 8; // feedback pass resolution divisor
+
+inline size_t virtualTileBytes ()
+{
+    return (size_t)VIRTUAL_TILE_SIZE * VIRTUAL_TILE_SIZE * 4;
+}
+
+// bake: resample to a square power of two page grid, mip it in linear light and cut
+// every level into bordered RGBA8 tiles. Each TextureImage level holds the tiles of
+// one virtual level row by row, width/height are counted in pages. Longitude (u)
+// wraps across the border, latitude (v) is clamped.
+// --------------------------------------------------------------------------------
+inline void buildVirtualTiles (const unsigned char * pixels, int width, int height, int channels, TextureImage & tiles)
+{
+    int pagesNeeded = std::max((width + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE, (height + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE);
+    int pages = 1;
+    while (pages < pagesNeeded)
+        pages *= 2;
+    int size = pages * VIRTUAL_PAGE_SIZE;
+
+    // bilinear resample of the source to size x size, RGBA
+    std::vector<unsigned char> base((size_t)size * size * 4);
+    parallelRows(size, std::max(1u, std::thread::hardware_concurrency()), [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            float sy = std::min(std::max((y + 0.5f) * height / size - 0.5f, 0.0f), height - 1.0f);
+            int y0 = (int)sy, y1 = std::min(y0 + 1, height - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < size; ++x)
+            {
+                float sx = std::min(std::max((x + 0.5f) * width / size - 0.5f, 0.0f), width - 1.0f);
+                int x0 = (int)sx, x1 = std::min(x0 + 1, width - 1);
+                float fx = sx - x0;
+                unsigned char * out = &base[((size_t)y * size + x) * 4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    int channel = c < channels ? c : (c == 3 ? -1 : 0);
+                    if (channel < 0)
+                    {
+                        out[c] = 255;
+                        continue;
+                    }
+                    float a = pixels[((size_t)y0 * width + x0) * channels + channel], b = pixels[((size_t)y0 * width + x1) * channels + channel];
+                    float d = pixels[((size_t)y1 * width + x0) * channels + channel], e = pixels[((size_t)y1 * width + x1) * channels + channel];
+                    out[c] = (unsigned char)((a + (b - a) * fx) * (1.0f - fy) + (d + (e - d) * fx) * fy + 0.5f);
+                }
+            }
+        }
+    });
+
+    MipOptions options;
+    options.filter = MIP_KAISER;
+    std::vector<MipLevelData> mips;
+    generateMips(&base[0], size, size, 4, options, mips);
+
+    tiles.internalFormat = GL_RGBA8;
+    tiles.format = GL_RGBA;
+    tiles.type = GL_UNSIGNED_BYTE;
+    tiles.compressed = false;
+    tiles.channels = 4;
+    tiles.gutter = VIRTUAL_PAGE_BORDER;
+    tiles.contentWidth = width;
+    tiles.contentHeight = height;
+    tiles.levels.clear();
+    tiles.storage.clear();
+
+    for (int k = 0; pages >> k >= 1; ++k)
+    {
+        const unsigned char * src = k == 0 ? &base[0] : &mips[k - 1].pixels[0];
+        int levelSize = size >> k, levelPages = pages >> k;
+
+        TextureLevel level;
+        level.width = level.height = levelPages;
+        level.offset = tiles.storage.size();
+        level.size = (size_t)levelPages * levelPages * virtualTileBytes();
+        tiles.storage.resize(level.offset + level.size);
+        unsigned char * dst = &tiles.storage[level.offset];
+        for (int py = 0; py < levelPages; ++py)
+            for (int px = 0; px < levelPages; ++px)
+                for (int y = 0; y < VIRTUAL_TILE_SIZE; ++y)
+                {
+                    int sy = std::min(std::max(py * VIRTUAL_PAGE_SIZE + y - VIRTUAL_PAGE_BORDER, 0), levelSize - 1);
+                    for (int x = 0; x < VIRTUAL_TILE_SIZE; ++x)
+                    {
+                        int sx = ((px * VIRTUAL_PAGE_SIZE + x - VIRTUAL_PAGE_BORDER) % levelSize + levelSize) % levelSize;
+                        memcpy(dst, src + ((size_t)sy * levelSize + sx) * 4, 4);
+                        dst += 4;
+                    }
+                }
+        tiles.levels.push_back(level);
+    }
+}
+
+// virtual texture of one source map
+// ---------------------------------
+class VirtualTexture {
+public:
+    // per frame numbers for the stats window; pending counts pages asked for and not
+    // in the cache yet, and is 1 while the tiles are still being baked
+    unsigned int m_requested, m_loaded, m_evicted, m_resident, m_pending;
+
+    VirtualTexture (int slotsPerSide = 8, unsigned int uploadsPerFrame = 16)
+        : m_requested(0), m_loaded(0), m_evicted(0), m_resident(0), m_pending(0),
+          m_slotsPerSide(slotsPerSide), m_uploadsPerFrame(uploadsPerFrame),
+          m_indirection(0), m_physical(0), m_feedbackFBO(0), m_feedbackColor(0), m_feedbackDepth(0),
+          m_feedbackWidth(0), m_feedbackHeight(0), m_nextPBO(0), m_frame(0),
+          m_ready(false), m_failed(false), m_quit(false), m_pages(1), m_levels(1)
+    {
+        m_feedbackPBOs[0] = m_feedbackPBOs[1] = 0;
+        m_feedbackPending[0] = m_feedbackPending[1] = false;
+    }
+
+    ~VirtualTexture ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        if (m_worker.joinable())
+            m_worker.join();
+    }
+
+    // needs a current GL context; baking (on a cache miss) and tile reads run on a worker
+    void init (const char * path)
+    {
+        m_path = path;
+
+        // physical cache, mid grey until pages arrive; slot 0 is what the empty
+        // indirection points at
+        int size = m_slotsPerSide * VIRTUAL_TILE_SIZE;
+        std::vector<unsigned char> grey((size_t)size * size * 4, 128);
+        glGenTextures(1, &m_physical);
+        glBindTexture(GL_TEXTURE_2D, m_physical);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &grey[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        m_slots.assign(m_slotsPerSide * m_slotsPerSide, Slot());
+
+        // 1x1 indirection to slot 0 until the page grid is known
+        unsigned char empty[4] = { 0, 0, 0, 0 };
+        glGenTextures(1, &m_indirection);
+        glBindTexture(GL_TEXTURE_2D, m_indirection);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, empty);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &m_feedbackFBO);
+        glGenTextures(1, &m_feedbackColor);
+        glGenRenderbuffers(1, &m_feedbackDepth);
+        glGenBuffers(2, m_feedbackPBOs);
+
+        m_worker = std::thread(&VirtualTexture::loadLoop, this);
+    }
+
+    // bind the page table and the page cache and set the sampling uniforms
+    void bind (const Shader & shader, unsigned int indirectionUnit = 4, unsigned int physicalUnit = 5) const
+    {
+        glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+        glBindTexture(GL_TEXTURE_2D, m_indirection);
+        glActiveTexture(GL_TEXTURE0 + physicalUnit);
+        glBindTexture(GL_TEXTURE_2D, m_physical);
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.use();
+        shader.setInt("virtualTexture.indirection", indirectionUnit);
+        shader.setInt("virtualTexture.physical", physicalUnit);
+        shader.setInt("virtualTexture.pages", m_pages);
+        shader.setInt("virtualTexture.levels", m_levels);
+        shader.setFloat("virtualTexture.slots", m_slotsPerSide);
+    }
+
+    // uniforms of the feedback shader
+    void bindFeedback (const Shader & shader) const
+    {
+        shader.use();
+        shader.setInt("pages", m_pages);
+        shader.setInt("levels", m_levels);
+        shader.setFloat("lodBias", log2((float)VIRTUAL_FEEDBACK_SCALE));
+    }
+
+    // feedback pass: draw the virtually textured objects with the feedback shader between these
+    // -------------------------------------------------------------------------------------------
+    void beginFeedback (int displayWidth, int displayHeight)
+    {
+        int width = std::max(1, displayWidth / VIRTUAL_FEEDBACK_SCALE), height = std::max(1, displayHeight / VIRTUAL_FEEDBACK_SCALE);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFBO);
+        if (width != m_feedbackWidth || height != m_feedbackHeight)
+        {
+            m_feedbackWidth = width;
+            m_feedbackHeight = height;
+            glBindTexture(GL_TEXTURE_2D, m_feedbackColor);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_feedbackColor, 0);
+            glBindRenderbuffer(GL_RENDERBUFFER, m_feedbackDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_feedbackDepth);
+            for (unsigned int i = 0; i < 2; ++i)
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackPBOs[i]);
+                glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+                m_feedbackPending[i] = false;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        glViewport(0, 0, width, height);
+        // alpha 0 marks texels that asked for nothing
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, m_clearColor);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // start the asynchronous read back; update() consumes it a frame later
+    void endFeedback (int displayWidth, int displayHeight)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackPBOs[m_nextPBO]);
+        glReadPixels(0, 0, m_feedbackWidth, m_feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_feedbackPending[m_nextPBO] = true;
+        m_nextPBO = 1 - m_nextPBO;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+        glViewport(0, 0, displayWidth, displayHeight);
+        glClearColor(m_clearColor[0], m_clearColor[1], m_clearColor[2], m_clearColor[3]);
+    }
+
+    // once per frame on the GL thread: read last frame's feedback, queue missing pages,
+    // place finished ones in the cache and rewrite the page table if anything moved
+    void update ()
+    {
+        m_frame++;
+        m_requested = m_loaded = m_evicted = 0;
+
+        bool ready, failed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ready = m_ready;
+            failed = m_failed;
+        }
+        m_pending = failed ? 0 : 1;
+        if (failed || !ready)
+            return;
+        if (m_slotOf.empty())
+            createPageTable();
+
+        std::vector<uint32_t> wanted;
+        readFeedback(wanted);
+        // the single page of the last level backs every miss and is never evicted
+        wanted.push_back(pageKey(m_levels - 1, 0, 0));
+
+        // the whole chain of coarser pages is wanted too: trilinear filtering reads the
+        // next level and a missing page falls back to its closest resident ancestor
+        std::vector<uint32_t> missing;
+        for (uint32_t key : wanted)
+        {
+            int level = key >> 24, x = key & 0xFFF, y = (key >> 12) & 0xFFF;
+            for (int l = level; l < m_levels; ++l)
+            {
+                uint32_t ancestor = pageKey(l, x >> (l - level), y >> (l - level));
+                int slot = m_slotOf[l][(y >> (l - level)) * (m_pages >> l) + (x >> (l - level))];
+                if (slot >= 0)
+                    m_slots[slot].lastUsed = m_frame;
+                else if (m_inFlight.insert(ancestor).second)
+                    missing.push_back(ancestor);
+            }
+        }
+        std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return (a >> 24) > (b >> 24); });
+        m_requested = wanted.size();
+
+        std::deque<LoadedPage> arrived;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (uint32_t key : missing)
+                m_queue.push_back(key);
+            for (unsigned int i = 0; i < m_uploadsPerFrame && !m_done.empty(); ++i)
+            {
+                arrived.push_back(std::move(m_done.front()));
+                m_done.pop_front();
+            }
+        }
+        if (!missing.empty())
+            m_wake.notify_one();
+
+        bool dirty = false;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, m_physical);
+        for (LoadedPage & page : arrived)
+        {
+            m_inFlight.erase(page.key);
+            int slot = allocateSlot();
+            if (slot < 0)
+                continue; // everything is in use this frame, the page gets asked for again
+            int level = page.key >> 24;
+            Slot & entry = m_slots[slot];
+            entry.key = page.key;
+            entry.lastUsed = m_frame;
+            entry.pinned = level == m_levels - 1;
+            m_slotOf[level][((page.key >> 12) & 0xFFF) * (m_pages >> level) + (page.key & 0xFFF)] = slot;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % m_slotsPerSide) * VIRTUAL_TILE_SIZE, (slot / m_slotsPerSide) * VIRTUAL_TILE_SIZE,
+                            VIRTUAL_TILE_SIZE, VIRTUAL_TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, &page.texels[0]);
+            m_loaded++;
+            dirty = true;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (dirty)
+            writePageTable();
+
+        m_resident = 0;
+        for (const Slot & slot : m_slots)
+            m_resident += slot.key != EMPTY;
+        m_pending = m_inFlight.size();
+    }
+
+    unsigned int slotCount () const
+    {
+        return m_slots.size();
+    }
+
+private:
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+
+    struct Slot {
+        uint32_t key = EMPTY;
+        unsigned int lastUsed = 0;
+        bool pinned = false;
+    };
+
+    struct LoadedPage {
+        uint32_t key;
+        std::vector<unsigned char> texels;
+    };
+
+    std::string m_path;
+    int m_slotsPerSide;
+    unsigned int m_uploadsPerFrame;
+    unsigned int m_indirection, m_physical;
+    unsigned int m_feedbackFBO, m_feedbackColor, m_feedbackDepth;
+    int m_feedbackWidth, m_feedbackHeight;
+    unsigned int m_feedbackPBOs[2];
+    bool m_feedbackPending[2];
+    unsigned int m_nextPBO;
+    float m_clearColor[4];
+    unsigned int m_frame;
+
+    // GL thread only
+    std::vector<Slot> m_slots;
+    std::vector<std::vector<int>> m_slotOf; // per level, slot of every page or -1
+    std::unordered_set<uint32_t> m_inFlight;
+
+    // shared with the worker
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_worker;
+    std::deque<uint32_t> m_queue;
+    std::deque<LoadedPage> m_done;
+    TextureImage m_tiles; // mapped .vtex, read only once m_ready
+    bool m_ready, m_failed;
+    bool m_quit;
+
+    // page grid, 1x1 until the tiles are ready
+    int m_pages, m_levels;
+
+    static uint32_t pageKey (int level, int x, int y)
+    {
+        return (uint32_t)level << 24 | (uint32_t)y << 12 | (uint32_t)x;
+    }
+
+    void loadLoop ()
+    {
+        TextureImage tiles;
+        bool loaded = loadBakedImage(m_path.c_str(), ".vtex", VIRTUAL_TILE_SIZE, buildVirtualTiles, tiles);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!loaded)
+            {
+                std::cout << "ERROR::VIRTUAL_TEXTURE::LOAD_FAILED " << m_path << std::endl;
+                m_failed = true;
+                return;
+            }
+            m_tiles = std::move(tiles);
+            m_ready = true;
+        }
+
+        for (;;)
+        {
+            uint32_t key;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+                if (m_quit)
+                    return;
+                key = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            // copying out of the mapping is where the page faults (the disk reads) happen
+            int level = key >> 24, x = key & 0xFFF, y = (key >> 12) & 0xFFF;
+            LoadedPage page;
+            page.key = key;
+            const unsigned char * tile = m_tiles.levelData(level) + ((size_t)y * m_tiles.levels[level].width + x) * virtualTileBytes();
+            page.texels.assign(tile, tile + virtualTileBytes());
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.push_back(std::move(page));
+        }
+    }
+
+    void createPageTable ()
+    {
+        m_pages = m_tiles.levels[0].width;
+        m_levels = m_tiles.levels.size();
+        m_slotOf.resize(m_levels);
+        for (int level = 0; level < m_levels; ++level)
+            m_slotOf[level].assign((m_pages >> level) * (m_pages >> level), -1);
+
+        glBindTexture(GL_TEXTURE_2D, m_indirection);
+        for (int level = 0; level < m_levels; ++level)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, m_pages >> level, m_pages >> level, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+        writePageTable();
+    }
+
+    // every page points at its own slot, or at the closest coarser resident page;
+    // rgb = slot x, slot y, level the slot holds
+    void writePageTable ()
+    {
+        std::vector<std::vector<unsigned char>> table(m_levels);
+        for (int level = m_levels - 1; level >= 0; --level)
+        {
+            int pages = m_pages >> level;
+            table[level].resize((size_t)pages * pages * 4);
+            for (int y = 0; y < pages; ++y)
+                for (int x = 0; x < pages; ++x)
+                {
+                    unsigned char * entry = &table[level][((size_t)y * pages + x) * 4];
+                    int slot = m_slotOf[level][y * pages + x];
+                    if (slot >= 0)
+                    {
+                        entry[0] = slot % m_slotsPerSide;
+                        entry[1] = slot / m_slotsPerSide;
+                        entry[2] = level;
+                        entry[3] = 255;
+                    }
+                    else if (level + 1 < m_levels)
+                        memcpy(entry, &table[level + 1][((size_t)(y / 2) * (pages / 2) + x / 2) * 4], 4);
+                    else
+                        memset(entry, 0, 4);
+                }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, m_indirection);
+        for (int level = 0; level < m_levels; ++level)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, m_pages >> level, m_pages >> level, GL_RGBA, GL_UNSIGNED_BYTE, &table[level][0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    // the read back started last frame: unique (level, x, y) requests
+    void readFeedback (std::vector<uint32_t> & wanted)
+    {
+        unsigned int index = m_nextPBO; // the older of the two
+        if (!m_feedbackPending[index])
+            return;
+        m_feedbackPending[index] = false;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackPBOs[index]);
+        const unsigned char * texels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_feedbackWidth * m_feedbackHeight * 4, GL_MAP_READ_BIT);
+        if (texels)
+        {
+            std::unordered_set<uint32_t> unique;
+            for (int i = 0; i < m_feedbackWidth * m_feedbackHeight; ++i)
+            {
+                const unsigned char * texel = texels + i * 4;
+                if (texel[3] == 0 || texel[2] >= m_levels)
+                    continue;
+                int level = texel[2], pages = m_pages >> level;
+                if (texel[0] < pages && texel[1] < pages && unique.insert(pageKey(level, texel[0], texel[1])).second)
+                    wanted.push_back(pageKey(level, texel[0], texel[1]));
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // a free slot, or the least recently used one nobody asked for this frame
+    int allocateSlot ()
+    {
+        int victim = -1;
+        for (unsigned int i = 0; i < m_slots.size(); ++i)
+        {
+            const Slot & slot = m_slots[i];
+            if (slot.key == EMPTY)
+                return i;
+            if (!slot.pinned && slot.lastUsed < m_frame && (victim < 0 || slot.lastUsed < m_slots[victim].lastUsed))
+                victim = i;
+        }
+        if (victim >= 0)
+        {
+            uint32_t key = m_slots[victim].key;
+            int level = key >> 24;
+            m_slotOf[level][((key >> 12) & 0xFFF) * (m_pages >> level) + (key & 0xFFF)] = -1;
+            m_slots[victim].key = EMPTY;
+            m_evicted++;
+        }
+        return victim;
+    }
+};
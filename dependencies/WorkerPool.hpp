@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// threads started once and parked between jobs, for the work split up every frame
+// (light binning, the occlusion raster and its queries); the calling thread takes
+// items too, so a job never waits for a wake-up to make progress
+// ---------------------------------------------------------------------------------
+class WorkerPool {
+public:
+    WorkerPool ()
+        : m_quit(false), m_generation(0), m_helpers(0), m_inside(0), m_work(nullptr), m_count(0), m_next(0)
+    {
+        unsigned int workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < workers; ++i)
+            m_threads.push_back(std::thread(&WorkerPool::workLoop, this));
+    }
+
+    ~WorkerPool ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (std::thread & thread : m_threads)
+            thread.join();
+    }
+
+    // threads a job can use, the caller's included
+    unsigned int size () const
+    {
+        return m_threads.size() + 1;
+    }
+
+    // work(0) .. work(count - 1) on at most `threads` threads, returns once all of
+    // them have; one job at a time, from one thread
+    void run (int count, const std::function<void (int)> & work, unsigned int threads)
+    {
+        threads = std::min(threads, std::min(size(), (unsigned int)std::max(count, 0)));
+        if (threads <= 1)
+        {
+            for (int i = 0; i < count; ++i)
+                work(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_work = &work;
+            m_count = count;
+            m_next = 0;
+            m_helpers = threads - 1;
+            m_generation++;
+        }
+        m_wake.notify_all();
+        drain();
+
+        // every item is taken, wait for the ones still running elsewhere
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_helpers = 0;
+        m_done.wait(lock, [this] { return m_inside == 0; });
+        m_work = nullptr;
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    bool m_quit;
+    unsigned int m_generation; // bumped per job
+    unsigned int m_helpers;    // workers the current job still takes
+    unsigned int m_inside;     // workers running items of the current job
+    const std::function<void (int)> * m_work;
+    int m_count;
+    std::atomic<int> m_next;
+
+    void drain ()
+    {
+        for (int i = m_next++; i < m_count; i = m_next++)
+            (*m_work)(i);
+    }
+
+    void workLoop ()
+    {
+        unsigned int seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wake.wait(lock, [&] { return m_quit || (m_generation != seen && m_helpers > 0); });
+            if (m_quit)
+                return;
+            seen = m_generation;
+            m_helpers--;
+            m_inside++;
+            lock.unlock();
+            drain();
+            lock.lock();
+            if (--m_inside == 0)
+                m_done.notify_one();
+        }
+    }
+};
+
+// the one pool everything per frame shares
+inline WorkerPool & workerPool ()
+{
+    static WorkerPool pool;
+    return pool;
+}
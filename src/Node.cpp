@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "Shader.hpp"
+#include "FrameContext.hpp"
 
 
 struct Transformation
@@ -53,6 +54,11 @@ public:
     unsigned int m_VAO;
     Shader m_shader;
     glm::vec3 m_color;
+    std::vector<int> m_lods; // sphere level picked last, per FrameContext::queryInstance; -1 before the first draw
+    bool m_textured; // set by setTexture, the shader samples the texture array
+    int m_texture; // TextureStreamer handle for textured nodes, -1 shows the placeholder
+    bool m_queryRoot; // the subtree from here is occlusion queried as one box
+    SubtreeBounds m_bounds; // that box in this node's frame, learnt while drawing
     // glm::mat4 m_model;
 
     Node (
@@ -64,8 +70,12 @@ public:
         : m_trans(trans),
           m_VAO(VAO),
           m_shader(shader),
-          m_color(glm::vec3(0.5f))
+          m_color(glm::vec3(0.5f)),
+          m_textured(false),
+          m_texture(-1),
+          m_queryRoot(false)
     {
+        // no uniform queries here: they would wait for the shader's asynchronous compile
         m_children.reserve(child_num); // reserve vector
         std::cout << "Node Constructed !\n";
     }
@@ -75,19 +85,197 @@ public:
         m_children.push_back(node);
     }
 
-    void draw (const glm::mat4 & model)
+    void setTexture (unsigned int handle)
+    {
+        m_texture = handle;
+        m_textured = true;
+    }
+
+    void draw (const glm::mat4 & model, FrameContext & frame)
     {
-        m_shader.use();
-        m_shader.setVec3("objectColor", m_color);
-        glBindVertexArray(m_VAO);
         glm::mat4 new_model = m_trans.getTrans(model);
         // m_model = new_model;
-        m_shader.setMat4("model", glm::scale(new_model, m_trans.m_scale));
+        glm::mat4 scaled_model = glm::scale(new_model, m_trans.m_scale);
+        // extra passes draw everything, only the shaded pass is queried
+        bool queried = m_queryRoot && frame.queries && !frame.shaderOverride;
+        if (queried && !frame.queries->beginSubtree(this, frame.queryInstance, new_model, m_bounds))
+            return;
+        if (frame.queries && !frame.shaderOverride)
+            frame.queries->record(scaled_model);
+        TextureSlot slot;
+        if (m_textured && frame.textures)
+            slot = frame.textures->slot(m_texture);
+        if (m_VAO == 2 && frame.impostors)
+        {
+            // ray traced later in one instanced draw
+            frame.impostors->add(scaled_model, m_color, m_textured, slot);
+        }
+        else
+        {
+            // attribute-less twin of the node's shader when procedural primitives are on
+            const Shader & base = frame.shaderOverride ? *frame.shaderOverride : m_shader;
+            const Shader & program = frame.deferred ? frame.deferred->variant(base) : base;
+            const Shader & shader = frame.procedural ? frame.procedural->variant(program) : program;
+            shader.use();
+            shader.setVec3("objectColor", m_color);
+            shader.setMat4("model", scaled_model);
+            if (m_textured)
+            {
+                // every texture shares the bound array, only the tile changes
+                shader.setFloat("textureLayer", slot.layer);
+                shader.setVec4("textureRect", slot.rect);
+            }
+            if (frame.procedural)
+                drawProcedural(shader, scaled_model, frame);
+            else
+            {
+                glBindVertexArray(frame.positionVAOs ? frame.positionVAOs[m_VAO] : m_VAO);
+                if (m_VAO == 1)
+                    glDrawArrays(GL_TRIANGLES, 0, 36);
+                if (m_VAO == 2)
+                    drawSphere(scaled_model, frame);
+            }
+        }
+        for (Node * child : m_children)
+            child->draw(new_model, frame);
+        if (queried)
+            frame.queries->endSubtree();
+    }
+
+    // the subtree once at every root in frame.instances, one instanced draw per part
+    // (per run of equal sphere levels) with the procedural SHADER_INSTANCED variants;
+    // `model` is where this node hangs inside a root. No occlusion queries here, and
+    // parts without an instanced variant fall back to a draw per root
+    void drawInstanced (const glm::mat4 & model, FrameContext & frame)
+    {
+        const std::vector<glm::mat4> & roots = *frame.instances;
+        glm::mat4 new_model = m_trans.getTrans(model);
+        glm::mat4 scaled_model = glm::scale(new_model, m_trans.m_scale);
+        TextureSlot slot;
+        if (m_textured && frame.textures)
+            slot = frame.textures->slot(m_texture);
+        if (m_VAO == 2 && frame.impostors)
+        {
+            for (const glm::mat4 & root : roots)
+                frame.impostors->add(root * scaled_model, m_color, m_textured, slot);
+        }
+        else
+        {
+            const Shader & base = frame.shaderOverride ? *frame.shaderOverride : m_shader;
+            const Shader & program = frame.deferred ? frame.deferred->variant(base) : base;
+            const Shader * instanced = frame.procedural->instancedVariant(program);
+            const Shader & shader = instanced ? *instanced : frame.procedural->variant(program);
+            shader.use();
+            shader.setVec3("objectColor", m_color);
+            if (m_textured)
+            {
+                shader.setFloat("textureLayer", slot.layer);
+                shader.setVec4("textureRect", slot.rect);
+            }
+            if (!instanced)
+            {
+                for (unsigned int i = 0; i < roots.size(); ++i)
+                {
+                    frame.queryInstance = (*frame.instanceIds)[i];
+                    shader.setMat4("model", roots[i] * scaled_model);
+                    drawProcedural(shader, roots[i] * scaled_model, frame);
+                }
+            }
+            else
+            {
+                shader.setMat4("model", scaled_model);
+                if (m_VAO == 1)
+                    frame.procedural->drawInstanced(shader, PROCEDURAL_CUBE, 1, 0, roots.size());
+                if (m_VAO == 2)
+                    drawSpheresInstanced(shader, scaled_model, frame);
+            }
+        }
+        for (Node * child : m_children)
+            child->drawInstanced(new_model, frame);
+    }
+
+    // farthest the subtree drawn at `model` reaches from `center` in the current pose;
+    // the corners of every node's unit box, which holds spheres too
+    float reach (const glm::mat4 & model, const glm::vec3 & center)
+    {
+        glm::mat4 new_model = m_trans.getTrans(model);
+        glm::mat4 scaled_model = glm::scale(new_model, m_trans.m_scale);
+        float farthest = 0.0f;
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 corner(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f, 1.0f);
+            farthest = glm::max(farthest, glm::length(glm::vec3(scaled_model * corner) - center));
+        }
+        for (Node * child : m_children)
+            farthest = glm::max(farthest, child->reach(new_model, center));
+        return farthest;
+    }
+
+private:
+    // tessellation level from the projected size, remembered per instance for the
+    // hysteresis; with frame.reuseLOD the level the last pass picked is drawn again
+    unsigned int sphereLevel (const glm::mat4 & model, FrameContext & frame)
+    {
+        if (frame.queryInstance >= m_lods.size())
+            m_lods.resize(frame.queryInstance + 1, -1);
+        int & lod = m_lods[frame.queryInstance];
+        if (frame.reuseLOD && lod >= 0)
+            return lod;
+
+        unsigned int level = 0;
+        if (frame.useSphereLOD)
+        {
+            float radius = projectedSphereRadius(model, frame.view, frame.projection, frame.viewportHeight);
+            level = selectSphereLOD(radius, lod);
+        }
+        lod = level;
+        return level;
+    }
+
+    // draw the chosen level's part of the shared triangle strip
+    void drawSphere (const glm::mat4 & model, FrameContext & frame)
+    {
+        unsigned int level = sphereLevel(model, frame);
+        const SphereLOD & lod = (*frame.sphereLODs)[level];
+        glDrawElements(GL_TRIANGLE_STRIP, lod.indexCount, GL_UNSIGNED_INT, (void*)(lod.firstIndex * sizeof(unsigned int)));
+        frame.lodStats.record(level, lod.triangles());
+    }
+
+    // same shapes generated from gl_VertexID, spheres keep their LOD as the segment count
+    void drawProcedural (const Shader & shader, const glm::mat4 & model, FrameContext & frame)
+    {
         if (m_VAO == 1)
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            frame.procedural->draw(shader, PROCEDURAL_CUBE, 1);
         if (m_VAO == 2)
-            glDrawElements(GL_TRIANGLE_STRIP, 8320, GL_UNSIGNED_INT, 0);
-        for (Node * child : m_children)
-            child->draw(new_model);
+        {
+            unsigned int level = sphereLevel(model, frame);
+            unsigned int segments = SPHERE_LOD_SEGMENTS[level];
+            frame.procedural->draw(shader, PROCEDURAL_SPHERE, segments);
+            frame.lodStats.record(level, proceduralVertexCount(PROCEDURAL_SPHERE, segments) / 3);
+        }
     }
-};
+
+    // every root keeps its own level and hysteresis; roots in a row on the same level
+    // (most of them once sorted by distance) share one instanced draw
+    void drawSpheresInstanced (const Shader & shader, const glm::mat4 & model, FrameContext & frame)
+    {
+        const std::vector<glm::mat4> & roots = *frame.instances;
+        unsigned int first = 0, runLevel = 0;
+        for (unsigned int i = 0; i <= roots.size(); ++i)
+        {
+            unsigned int level = runLevel;
+            if (i < roots.size())
+            {
+                frame.queryInstance = (*frame.instanceIds)[i];
+                level = sphereLevel(roots[i] * model, frame);
+                frame.lodStats.record(level, proceduralVertexCount(PROCEDURAL_SPHERE, SPHERE_LOD_SEGMENTS[level]) / 3);
+            }
+            if (i > first && (i == roots.size() || level != runLevel))
+            {
+                frame.procedural->drawInstanced(shader, PROCEDURAL_SPHERE, SPHERE_LOD_SEGMENTS[runLevel], first, i - first);
+                first = i;
+            }
+            runLevel = level;
+        }
+    }
+};
\ No newline at end of file
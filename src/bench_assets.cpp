@@ -0,0 +1,129 @@
+// Reading the resources/ files loose against out of an asset archive (stored,
+// and LZ4 where it pays): time and file syscalls to get every file's bytes
+// mapped and hashed, the way loadBakedImage starts. The syscalls are counted
+// through the linker's --wrap, see the bench_assets target. Build with
+// `make bench_assets` and run from build/ like the app; the page cache is warm.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AssetArchive.hpp"
+#include "BenchTiming.hpp"
+
+const int RUNS = 20;
+
+// every file syscall MappedFile makes goes through one of these
+unsigned int syscalls = 0;
+
+extern "C" {
+int __real_open (const char * path, int flags, ...);
+int __real_fstat (int fd, struct stat * info);
+void * __real_mmap (void * address, size_t length, int protection, int flags, int fd, off_t offset);
+int __real_munmap (void * address, size_t length);
+int __real_close (int fd);
+
+int __wrap_open (const char * path, int flags, ...)
+{
+    syscalls++;
+    mode_t mode = 0;
+    if (flags & O_CREAT)
+    {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, int);
+        va_end(arguments);
+    }
+    return __real_open(path, flags, mode);
+}
+int __wrap_fstat (int fd, struct stat * info) { syscalls++; return __real_fstat(fd, info); }
+void * __wrap_mmap (void * address, size_t length, int protection, int flags, int fd, off_t offset)
+{
+    syscalls++;
+    return __real_mmap(address, length, protection, flags, fd, offset);
+}
+int __wrap_munmap (void * address, size_t length) { syscalls++; return __real_munmap(address, length); }
+int __wrap_close (int fd) { syscalls++; return __real_close(fd); }
+}
+
+const char * FILES[] = {
+    "resources/Marc_Dekamps.png", "resources/Mercator-projection.png", "resources/container2.png",
+    "resources/container2_specular.png", "resources/awesomeface.png",
+    "resources/Marc_Dekamps.ppm", "resources/Mercator-projection.ppm"
+};
+
+// ms per run and syscalls per run
+template <typename F>
+void measure (const char * label, F work)
+{
+    // one untimed run to warm the page cache, its syscalls are not counted
+    work();
+    syscalls = 0;
+    uint64_t hash = 0;
+    double ms = timedMs([&] { hash += work(); }, RUNS);
+    std::cout << "  " << label << ": " << ms << " ms, "
+              << syscalls / RUNS << " file syscalls (hash " << (hash & 0xffff) << ")" << std::endl;
+}
+
+uint64_t readArchive (const char * path)
+{
+    AssetArchive archive;
+    if (!archive.open(path, "../"))
+        return 0;
+    uint64_t hash = 0;
+    for (const char * name : FILES)
+    {
+        AssetData asset;
+        if (archive.read(std::string("../") + name, asset))
+            hash ^= hashBytes(asset.data, asset.size);
+    }
+    return hash;
+}
+
+int main ()
+{
+    std::vector<AssetSource> sources;
+    size_t total = 0;
+    for (const char * name : FILES)
+    {
+        MappedFile file((std::string("../") + name).c_str());
+        if (!file.valid())
+        {
+            std::cout << "ERROR::BENCH::MISSING_INPUT " << name << std::endl;
+            return 1;
+        }
+        AssetSource source;
+        source.name = name;
+        source.bytes.assign(file.data(), file.data() + file.size());
+        total += file.size();
+        sources.push_back(source);
+    }
+    const char * stored = "../cache/bench_stored.pak", * compressed = "../cache/bench_lz4.pak";
+    mkdir("../cache/", 0755);
+    if (!writeAssetArchive(stored, sources, false) || !writeAssetArchive(compressed, sources, true))
+    {
+        std::cout << "ERROR::BENCH::CANNOT_WRITE ../cache/" << std::endl;
+        return 1;
+    }
+    std::cout << sources.size() << " files, " << total / 1024 << " KB; stored archive "
+              << MappedFile(stored).size() / 1024 << " KB, lz4 archive " << MappedFile(compressed).size() / 1024 << " KB" << std::endl;
+
+    measure("loose files", [&] {
+        uint64_t hash = 0;
+        for (const char * name : FILES)
+        {
+            MappedFile file((std::string("../") + name).c_str());
+            hash ^= hashBytes(file.data(), file.size());
+        }
+        return hash;
+    });
+    measure("stored archive", [&] { return readArchive(stored); });
+    measure("lz4 archive", [&] { return readArchive(compressed); });
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Mip chain generation for the resources/ images: the CPU generator (box and
+// Kaiser, one thread and all threads) against uploading the base level and
+// calling glGenerateMipmap. Build with `make bench_mips` and run from build/.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "BenchTiming.hpp"
+#include "MipGen.hpp"
+#include "TextureCache.hpp"
+
+const int RUNS = 10;
+
+void report (const char * label, double ms, size_t pixels)
+{
+    std::cout << "  " << label << ": " << ms << " ms, " << pixels / (ms * 1000.0) << " Mpixel/s" << std::endl;
+}
+
+void benchImage (const std::string & name)
+{
+    std::string path = "../resources/" + name + ".png";
+    int width, height, channels;
+    unsigned char * data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        std::cout << "ERROR::BENCH::MISSING_INPUT " << path << std::endl;
+        return;
+    }
+    size_t pixels = (size_t)width * height;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << name << " (" << width << "x" << height << ", " << channels << " channels, "
+              << threads << " threads)" << std::endl;
+
+    std::vector<MipLevelData> levels;
+    const MipFilter filters[] = { MIP_BOX, MIP_KAISER };
+    const char * labels[][2] = { { "cpu box    1 thread ", "cpu box    threaded " },
+                                 { "cpu kaiser 1 thread ", "cpu kaiser threaded " } };
+    for (int f = 0; f < 2; ++f)
+    {
+        MipOptions options;
+        options.filter = filters[f];
+        options.threads = 1;
+        report(labels[f][0], averageMs([&] { generateMips(data, width, height, channels, options, levels); }, RUNS), pixels);
+        options.threads = threads;
+        report(labels[f][1], averageMs([&] { generateMips(data, width, height, channels, options, levels); }, RUNS), pixels);
+    }
+
+    // what the app actually does on a cache miss, then the upload of the finished chain
+    TextureImage image;
+    double bakeMs = averageMs([&] { buildMipChain(data, width, height, channels, image); }, RUNS);
+    report("cpu bake   (cache) ", bakeMs, pixels);
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    double uploadMs = averageMs([&] {
+        uploadTextureImage(image);
+        glFinish();
+    }, RUNS);
+    report("gl  upload levels  ", uploadMs, pixels);
+
+    GLenum internalFormat, format;
+    textureFormats(channels, internalFormat, format);
+    double driverMs = averageMs([&] {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+    }, RUNS);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    report("gl  base + generate", driverMs, pixels);
+    glDeleteTextures(1, &texture);
+
+    stbi_image_free(data);
+}
+
+int main ()
+{
+    // the driver path needs a context, an invisible window is enough
+    if (!glfwInit())
+        return 1;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow * window = glfwCreateWindow(64, 64, "bench_mips", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        return 1;
+    std::cout << "GL_RENDERER " << glGetString(GL_RENDERER) << std::endl;
+
+    benchImage("Marc_Dekamps");
+    benchImage("Mercator-projection");
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
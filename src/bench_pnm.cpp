@@ -0,0 +1,90 @@
+// Decode throughput of the resources/ images: PNG through stb_image against
+// the PNM reader (plain P3 with the vectorised and the scalar parser, raw P6).
+// Build with `make bench_pnm` and run from build/ like the app.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BenchTiming.hpp"
+#include "MappedFile.hpp"
+#include "PNM.hpp"
+
+const int RUNS = 10;
+
+void report (const char * label, double ms, size_t sourceBytes, size_t pixels)
+{
+    std::cout << "  " << label << ": " << ms << " ms, "
+              << sourceBytes / (ms * 1000.0) << " MB/s source, "
+              << pixels / (ms * 1000.0) << " Mpixel/s" << std::endl;
+}
+
+void benchImage (const std::string & name)
+{
+    std::string png = "../resources/" + name + ".png";
+    std::string ppm = "../resources/" + name + ".ppm";
+    MappedFile pngFile(png.c_str()), ppmFile(ppm.c_str());
+    if (!pngFile.valid() || !ppmFile.valid())
+    {
+        std::cout << "ERROR::BENCH::MISSING_INPUT " << name << std::endl;
+        return;
+    }
+
+    PNMImage plain;
+    if (!decodePNM(ppmFile.data(), ppmFile.size(), plain))
+    {
+        std::cout << "ERROR::BENCH::PNM_DECODE_FAILED " << ppm << std::endl;
+        return;
+    }
+    size_t pixels = (size_t)plain.width * plain.height;
+    std::cout << name << " (" << plain.width << "x" << plain.height << ")" << std::endl;
+
+    double pngMs = averageMs([&] {
+        int width, height, nrComponents;
+        unsigned char * data = stbi_load_from_memory(pngFile.data(), pngFile.size(), &width, &height, &nrComponents, 0);
+        stbi_image_free(data);
+    }, RUNS);
+    report("png  stb_image     ", pngMs, pngFile.size(), pixels);
+
+    double p3Ms = averageMs([&] {
+        PNMImage image;
+        decodePNM(ppmFile.data(), ppmFile.size(), image);
+    }, RUNS);
+    report("P3   vectorised    ", p3Ms, ppmFile.size(), pixels);
+
+    // parser alone on the raster, to compare against the scalar reference
+    const unsigned char * raster = ppmFile.data() + 2;
+    int value;
+    for (int i = 0; i < 3; ++i)
+        raster = pnmHeaderInt(raster, ppmFile.data() + ppmFile.size(), value);
+    size_t rasterBytes = ppmFile.data() + ppmFile.size() - raster;
+    std::vector<unsigned short> values(pixels * 3);
+    double vectorMs = averageMs([&] {
+        parsePNMValues(raster, raster + rasterBytes, &values[0], values.size());
+    }, RUNS);
+    double scalarMs = averageMs([&] {
+        parsePNMValuesScalar(raster, raster + rasterBytes, &values[0], values.size());
+    }, RUNS);
+    report("P3   parse (simd)  ", vectorMs, rasterBytes, pixels);
+    report("P3   parse (scalar)", scalarMs, rasterBytes, pixels);
+
+    // same pixels as raw P6, which decodes without copying
+    std::string header = "P6\n" + std::to_string(plain.width) + " " + std::to_string(plain.height) + "\n255\n";
+    std::vector<unsigned char> raw(header.begin(), header.end());
+    raw.insert(raw.end(), plain.pixels, plain.pixels + pixels * 3);
+    double p6Ms = averageMs([&] {
+        PNMImage image;
+        decodePNM(&raw[0], raw.size(), image);
+    }, RUNS);
+    report("P6   zero copy     ", p6Ms, raw.size(), pixels);
+}
+
+int main ()
+{
+    benchImage("Marc_Dekamps");
+    benchImage("Mercator-projection");
+    return 0;
+}
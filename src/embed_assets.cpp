@@ -0,0 +1,93 @@
+// Build step for EmbeddedAssets.hpp: writes every input file as a string
+// literal into one generated header, named by its path below <root>.
+//   embed_assets <output.hpp> <root> <file>...
+// The Makefile runs it from build/ before main.o; the output is only rewritten
+// when it changes, so an untouched shader does not rebuild the app.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// one literal per source line keeps the generated header readable; anything
+// outside printable ASCII (or a small binary file) becomes three digit octal
+void writeLiteral (std::ostringstream & out, const std::string & data)
+{
+    out << "        \"";
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        unsigned char c = data[i];
+        if (c == '\n')
+        {
+            out << "\\n\"";
+            if (i + 1 < data.size())
+                out << "\n        \"";
+            else
+                return;
+        }
+        else if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c == '?')
+            out << "\\?"; // no trigraphs
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            char octal[8];
+            snprintf(octal, sizeof(octal), "\\%03o", c);
+            out << octal;
+        }
+        else
+            out << c;
+    }
+    out << "\"";
+}
+
+int main (int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "usage: embed_assets <output.hpp> <root> <file>..." << std::endl;
+        return 1;
+    }
+    std::string output = argv[1], root = argv[2];
+    if (!root.empty() && root.back() != '/')
+        root += '/';
+
+    std::ostringstream out;
+    out << "// generated by embed_assets from the Makefile, do not edit\n"
+           "// included by EmbeddedAssets.hpp, which defines EmbeddedAsset\n\n"
+           "constexpr EmbeddedAsset EMBEDDED_ASSETS[] = {\n";
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string path = argv[i];
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file || path.compare(0, root.size(), root) != 0)
+        {
+            std::cout << "ERROR::EMBED_ASSETS::CANNOT_EMBED " << path << std::endl;
+            return 1;
+        }
+        std::stringstream data;
+        data << file.rdbuf();
+        std::string bytes = data.str();
+
+        out << "    { \"" << path.substr(root.size()) << "\", std::string_view(\n";
+        writeLiteral(out, bytes);
+        out << ", " << bytes.size() << ") },\n";
+    }
+    out << "};\n";
+
+    // leave the header (and its timestamp) alone when nothing changed
+    std::ifstream previous(output.c_str(), std::ios::binary);
+    std::stringstream current;
+    current << previous.rdbuf();
+    if (previous && current.str() == out.str())
+        return 0;
+    std::ofstream file(output.c_str(), std::ios::binary);
+    file << out.str();
+    if (!file)
+    {
+        std::cout << "ERROR::EMBED_ASSETS::CANNOT_WRITE " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
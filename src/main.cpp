@@ -3,6 +3,10 @@
 // If you are new to Dear ImGui, read documentation from the docs/ folder + read the top of imgui.cpp.
 // Read online: https://github.com/ocornut/imgui/tree/master/docs
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -23,6 +27,20 @@
 #include "Camera.hpp"
 #include "Shader.hpp"
 #include "Node.cpp"
+#include "TextureStreamer.hpp"
+#include "VirtualTexture.hpp"
+#include "FileWatcher.hpp"
+#include "ClusteredLights.hpp"
+#include "DeferredRenderer.hpp"
+#include "GpuTimer.hpp"
+#include "ShadowMaps.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
+#include "Headless.hpp"
+#include "RenderTarget.hpp"
+#include "PNM.hpp"
+#include "FrameCapture.hpp"
+#include "Benchmark.hpp"
 // #include "cube.cpp"
 
 #define DRAW cubeShader.setMat4("model", trans); \
@@ -52,6 +70,16 @@ static void glfw_error_callback(int error, const char* description)
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
+// one node tree drawn at `model`, sorted on view depth; radius bounds it around model[3].
+// id stays with the draw through culling and sorting, the GPU queries key on it
+struct OpaqueDraw {
+    Node * node;
+    glm::mat4 model;
+    float radius;
+    float depth;
+    unsigned int id;
+};
+
 #define WINDOW_WIDTH 1920.0f
 #define WINDOW_HEIGHT 1080.0f
 
@@ -112,42 +140,124 @@ void processInput (GLFWwindow * window, Camera & camera, float deltaTime) {
     }
 }
 
-int main(int, char**)
+int main(int argc, char** argv)
 {    
+    // -------------------------------------------------------------------------
+    // command line: --headless renders without a display into a --size WxH
+    // framebuffer for --frames frames, the last one saved to --output (.ppm).
+    // --capture records every frame from the start (FrameCapture.hpp).
+    // --bench renders --warmup frames (more while anything still streams in) and
+    // then --frames measured ones at a fixed time step along a scripted camera path,
+    // and prints (or writes to --report) the frame time percentiles as JSON
+    // (Benchmark.hpp); its log lines go to stderr so stdout is only the JSON
+    // -------------------------------------------------------------------------
+    bool headless = false;
+    bool bench = false;
+    int frameWidth = WINDOW_WIDTH, frameHeight = WINDOW_HEIGHT;
+    int frames = 0, warmup = 60;
+    const char * outputPath = NULL;
+    const char * reportPath = NULL;
+    std::string captureTarget;
+    // a whole argument holding a count, zero included
+    auto parseCount = [](const char * text, int & count) {
+        char rest;
+        return sscanf(text, "%d%c", &count, &rest) == 1 && count >= 0;
+    };
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &frameWidth, &frameHeight) == 2)
+            ++i;
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc)
+            captureTarget = argv[++i];
+        else if (!strcmp(argv[i], "--bench"))
+            bench = true;
+        else if (!strcmp(argv[i], "--warmup") && i + 1 < argc && parseCount(argv[i + 1], warmup))
+            ++i;
+        else if (!strcmp(argv[i], "--report") && i + 1 < argc)
+            reportPath = argv[++i];
+        else
+        {
+            std::cout << "usage: app [--headless] [--size WxH] [--frames N] [--output frame.ppm]"
+                         " [--capture frame%05d.ppm | --capture \"|encoder command\"]"
+                         " [--bench [--warmup N] [--report bench.json]]" << std::endl;
+            return -1;
+        }
+    }
+    if (frames <= 0)
+        frames = bench ? 600 : 60;
+    if (bench)
+        std::cout.rdbuf(std::cerr.rdbuf());
+
     // ---------------
     // initializations 
     // ---------------
-    glfwInit();
-
-    // set opengl version
     const char* glsl_version = "#version 330";
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    // set core profile
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "learning", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "ERROR::WINDOW_CREATING_FAILURE" << std::endl;
-        glfwTerminate();
-        return -1;
+    GLFWwindow * window = NULL;
+    HeadlessContext context;
+    FrameBenchmark benchmark(warmup, frames);
+    RenderTarget target;
+    GLADloadproc loader;
+    if (headless)
+    {
+        if (!context.init())
+            return -1;
+        loader = (GLADloadproc)HeadlessContext::procAddress;
+    }
+    else
+    {
+        glfwInit();
+
+        // set opengl version
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        // set core profile
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(frameWidth, frameHeight, "learning", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "ERROR::WINDOW_CREATING_FAILURE" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        // mouse
+        // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // glfwSetCursorPosCallback(window, mouseCallback);
+        glfwMakeContextCurrent(window);
+        loader = (GLADloadproc)glfwGetProcAddress;
     }
-    // mouse
-    // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    // glfwSetCursorPosCallback(window, mouseCallback);
-    glfwMakeContextCurrent(window);
     // glad set up
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(loader)) {
         std::cout << "ERROR::GLAD_RETRIVE_FAILURE" << std::endl;
-        glfwTerminate();
+        if (!headless)
+            glfwTerminate();
         return -1;
     }
+    // no window framebuffer when headless, everything lands in the target instead
+    if (headless)
+    {
+        if (!target.init(frameWidth, frameHeight))
+            return -1;
+        target.makeDefault();
+    }
+    auto seconds = [&]() { return bench ? benchmark.time() : headless ? context.time() : glfwGetTime(); };
+    if (bench)
+        benchmark.init();
+    // program binaries and parallel compile are past glad's 3.3, fetched through the same loader
+    programCache().init(loader);
+    shaderCompiler().init(loader);
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     ImGui::StyleColorsDark();
-    // Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    // Setup Platform/Renderer backends, the stats window still draws into the target headless
+    if (!headless)
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
     // imgui states
     bool show_demo_window = true;
@@ -166,17 +276,17 @@ int main(int, char**)
     glm::vec3 leftArm_color;
     glm::vec3 rightArm_color;
     
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    glViewport(0, 0, frameWidth, frameHeight);
     glEnable(GL_DEPTH_TEST);
 
     // sphere data
     std::vector<unsigned int> sphereIndices;
     std::vector<float> sphereVertices;
+    std::vector<SphereLOD> sphereLODs;
 
     unsigned int cubeVAO;
     glGenVertexArrays(1, &cubeVAO);
     // cubeVAO is 1
-    buildCubeData(cubeVAO);
 
     // sphere
     // ------
@@ -184,27 +294,207 @@ int main(int, char**)
     unsigned int sphereVAO;
     glGenVertexArrays(1, &sphereVAO);
     // sphereVAO is 2
-    buildSphereData(sphereVAO, sphereIndices, sphereVertices);
+
+    // position-only twins of both, indexed like Node::m_VAO, for the depth pre-pass
+    unsigned int positionVAOs[3] = { 0, 0, 0 };
+    glGenVertexArrays(2, positionVAOs + 1);
+    buildCubeData(cubeVAO, positionVAOs[1]);
+    buildSphereData(sphereVAO, sphereIndices, sphereVertices, sphereLODs, positionVAOs[2]);
+
+    // per frame render state handed to every Node::draw
+    FrameContext frame;
+    frame.sphereLODs = &sphereLODs;
 
     // -----------
     // set shaders
     // -----------
 
-    Shader cubeShader("../GLSLs/cube_vertex.glsl", "../GLSLs/cube_fragment.glsl");
-    Shader lightShader("../GLSLs/light_vertex.glsl", "../GLSLs/light_fragment.glsl");
-    Shader colorShader("../GLSLs/colored_vertex.glsl", "../GLSLs/colored_fragment.glsl");
+    // every program is a (vertex, fragment, features) variant, built once and cached;
+    // the GLSL is embedded in the binary (EmbeddedAssets.hpp), names are repo relative
+    ShaderVariants shaders;
+    const Shader & cubeShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR);
+    const Shader & cubeMatteShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED);
+    const Shader & lightShader = shaders.get("GLSLs/light_vertex.glsl", "GLSLs/light_fragment.glsl");
+    const Shader & colorShader = shaders.get("GLSLs/colored_vertex.glsl", "GLSLs/colored_fragment.glsl");
+    const Shader & impostorShader = shaders.get("GLSLs/impostor_vertex.glsl", "GLSLs/impostor_fragment.glsl", SHADER_SPECULAR);
+
+    // attribute-less twins of the mesh shaders
+    const Shader & cubeProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR);
+    const Shader & cubeMatteProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED);
+    const Shader & lightProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/light_fragment.glsl");
+    const Shader & colorProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/colored_fragment.glsl");
+
+    // virtually textured Earth and the pass that tells it which pages to stream
+    const Shader & earthShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_SPECULAR);
+    const Shader & earthMatteShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/virtual_fragment.glsl");
+    const Shader & earthProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_SPECULAR);
+    const Shader & earthMatteProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/virtual_fragment.glsl");
+    const Shader & feedbackShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/virtual_feedback_fragment.glsl");
+    const Shader & feedbackProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/virtual_feedback_fragment.glsl");
+
+    // shadow casters of the main light, any node drawn with these writes its distance
+    const Shader & shadowShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/shadow_fragment.glsl");
+    const Shader & shadowProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/shadow_fragment.glsl");
+
+    // depth pre-pass: the position-only stream, then the scene shades with GL_EQUAL
+    const Shader & depthShader = shaders.get("GLSLs/depth_vertex.glsl", "GLSLs/depth_fragment.glsl");
+    const Shader & depthProcShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/depth_fragment.glsl");
+    const Shader & impostorDepthShader = shaders.get("GLSLs/impostor_vertex.glsl", "GLSLs/impostor_fragment.glsl", SHADER_DEPTH_ONLY);
+    bool useDepthPrepass = false;
+    bool sortFrontToBack = true;
+    std::vector<OpaqueDraw> opaqueDraws;
+
+    // the Earth and the animated robot's body hide what is behind them from the
+    // draw list, rasterised on the CPU each frame (OcclusionCuller.hpp)
+    OcclusionCuller occlusion;
+    OccluderMesh sphereOccluder = occluderFromSphere(sphereVertices, sphereIndices, sphereLODs[2]);
+    OccluderMesh boxOccluder = occluderBox();
+    bool useOcclusionCulling = true;
+    std::vector<glm::vec4> occludeeSpheres;
+    std::vector<unsigned char> occludeeVisible;
+    // hardware queries on the robots' hip and body subtrees, answered a frame late
+    // (OcclusionQueries.hpp); they share GL_SAMPLES_PASSED's slot with the fragment
+    // count below, which is left out (and not shown) while they run
+    OcclusionQueries queries;
+    queries.init(depthShader, positionVAOs[1]);
+    bool useOcclusionQueries = false;
+    // recording of the scene without the UI, read back a couple of frames late and
+    // written on a thread; headless runs keep every frame, interactive ones drop
+    FrameCapture capture;
+    capture.m_blocking = headless;
+    bool recordFrames = !captureTarget.empty();
+    if (captureTarget.empty())
+        captureTarget = "capture%05d.ppm";
+    // fragments surviving the depth test in either pass
+    SampleCounter prepassSamples, shadedSamples;
+    prepassSamples.init();
+    shadedSamples.init();
+    bool useSpecular = true;
+
+    // G-buffer writers of the lit shaders and the fullscreen pass that lights them
+    const Shader & cubeDeferredShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR | SHADER_DEFERRED);
+    const Shader & cubeMatteDeferredShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_DEFERRED);
+    const Shader & colorDeferredShader = shaders.get("GLSLs/colored_vertex.glsl", "GLSLs/colored_fragment.glsl", SHADER_DEFERRED);
+    const Shader & earthDeferredShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_SPECULAR | SHADER_DEFERRED);
+    const Shader & earthMatteDeferredShader = shaders.get("GLSLs/cube_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_DEFERRED);
+    const Shader & impostorDeferredShader = shaders.get("GLSLs/impostor_vertex.glsl", "GLSLs/impostor_fragment.glsl", SHADER_SPECULAR | SHADER_DEFERRED);
+    const Shader & cubeProcDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR | SHADER_DEFERRED);
+    const Shader & cubeMatteProcDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_DEFERRED);
+    const Shader & colorProcDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/colored_fragment.glsl", SHADER_DEFERRED);
+    const Shader & earthProcDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_SPECULAR | SHADER_DEFERRED);
+    const Shader & earthMatteProcDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/virtual_fragment.glsl", SHADER_DEFERRED);
+    const Shader & resolveShader = shaders.get("GLSLs/fullscreen_vertex.glsl", "GLSLs/deferred_fragment.glsl", SHADER_SPECULAR);
+
+    // the procedural twins the robots use, reading one matrix per gl_InstanceID (crowd)
+    const Shader & cubeInstShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR | SHADER_INSTANCED);
+    const Shader & cubeMatteInstShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_INSTANCED);
+    const Shader & colorInstShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/colored_fragment.glsl", SHADER_INSTANCED);
+    const Shader & shadowInstShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/shadow_fragment.glsl", SHADER_INSTANCED);
+    const Shader & depthInstShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/depth_fragment.glsl", SHADER_INSTANCED);
+    const Shader & cubeInstDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_SPECULAR | SHADER_INSTANCED | SHADER_DEFERRED);
+    const Shader & cubeMatteInstDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/cube_fragment.glsl", SHADER_TEXTURED | SHADER_INSTANCED | SHADER_DEFERRED);
+    const Shader & colorInstDeferredShader = shaders.get("GLSLs/procedural_vertex.glsl", "GLSLs/colored_fragment.glsl", SHADER_INSTANCED | SHADER_DEFERRED);
+
+    DeferredRenderer deferred;
+    deferred.init();
+    deferred.addVariant(cubeShader, cubeDeferredShader);
+    deferred.addVariant(cubeMatteShader, cubeMatteDeferredShader);
+    deferred.addVariant(colorShader, colorDeferredShader);
+    deferred.addVariant(earthShader, earthDeferredShader);
+    deferred.addVariant(earthMatteShader, earthMatteDeferredShader);
+    bool useDeferred = false;
+    GpuTimer sceneTimer;
+    sceneTimer.init();
+
+    ProceduralPrimitives procedural;
+    procedural.init();
+    procedural.addVariant(cubeShader, cubeProcShader);
+    procedural.addVariant(cubeMatteShader, cubeMatteProcShader);
+    procedural.addVariant(lightShader, lightProcShader);
+    procedural.addVariant(colorShader, colorProcShader);
+    procedural.addVariant(earthShader, earthProcShader);
+    procedural.addVariant(earthMatteShader, earthMatteProcShader);
+    procedural.addVariant(feedbackShader, feedbackProcShader);
+    procedural.addVariant(shadowShader, shadowProcShader);
+    procedural.addVariant(depthShader, depthProcShader);
+    procedural.addVariant(cubeDeferredShader, cubeProcDeferredShader);
+    procedural.addVariant(cubeMatteDeferredShader, cubeMatteProcDeferredShader);
+    procedural.addVariant(colorDeferredShader, colorProcDeferredShader);
+    procedural.addVariant(earthDeferredShader, earthProcDeferredShader);
+    procedural.addVariant(earthMatteDeferredShader, earthMatteProcDeferredShader);
+    procedural.addInstancedVariant(cubeShader, cubeInstShader);
+    procedural.addInstancedVariant(cubeMatteShader, cubeMatteInstShader);
+    procedural.addInstancedVariant(colorShader, colorInstShader);
+    procedural.addInstancedVariant(shadowShader, shadowInstShader);
+    procedural.addInstancedVariant(depthShader, depthInstShader);
+    procedural.addInstancedVariant(cubeDeferredShader, cubeInstDeferredShader);
+    procedural.addInstancedVariant(cubeMatteDeferredShader, cubeMatteInstDeferredShader);
+    procedural.addInstancedVariant(colorDeferredShader, colorInstDeferredShader);
+    bool useProcedural = false;
+    // with procedural primitives on, the crowd goes out as one instanced draw per part
+    // (Node::drawInstanced) instead of a tree walk per robot; it is not occlusion queried
+    bool useInstancedCrowd = true;
+    std::vector<glm::mat4> crowdModels;
+    std::vector<unsigned int> crowdIds;
+
+    // ray traced spheres, filled by Node::draw when enabled
+    SphereImpostors impostors;
+    impostors.init();
+    bool useImpostors = false;
+    int crowdSize = 0;
 
     // ------------
     // load texture
     // ------------
-    unsigned int face_map = loadTexture("../resources/Marc_Dekamps.png");
-    unsigned int earth_map = loadTexture("../resources/Mercator-projection.png");
+    // resources/ out of the archive `make` packs next to the app (AssetArchive.hpp);
+    // loose files without one, and always with ASSET_DIR set for development
+    if (assetOverrideDir().empty() && assetArchive().open("assets.pak", "../"))
+        std::cout << "asset archive: " << assetArchive().entryCount() << " entries, "
+                  << assetArchive().bytes() / 1024 << " KB mapped" << std::endl;
+
+    // decoded on worker threads and packed into one texture array, see Node::setTexture
+    TextureStreamer textures;
+    textures.init();
+    unsigned int face_map = textures.request("../resources/Marc_Dekamps.png");
+    unsigned int earth_map = textures.request("../resources/Mercator-projection.png");
+
+    // the same map paged in on demand, for the Earth when "virtual texture" is on
+    VirtualTexture earthPages;
+    earthPages.init("../resources/Mercator-projection.png");
+    bool useVirtualTexture = true;
+    int nodeShaderChoice = -1; // the switches head and Earth were last given shaders for
+
+    // edits under resources/ rebuild the textures that use them, the edited file
+    // taking over from its archive entry; edits under GLSLs/ the programs: ASSET_DIR's
+    // or, without it, the checkout's when the app runs from build/ (EmbeddedAssets.hpp)
+    FileWatcher watcher;
+    if (!assetSourceDir().empty())
+        watcher.watch(assetSourceDir() + "GLSLs/");
+    watcher.watch("../resources/");
+
+    // point and spot lights on top of the slider light, binned per frame into view
+    // space clusters so a fragment only walks the lights that reach it
+    ClusteredLights clusters;
+    clusters.init();
+    std::vector<SceneLight> sceneLights;
+    int lightCount = 0;
+
+    // cube shadow map of the slider light: the Earth is cached until the light
+    // moves, the animated robot and the crowd are drawn over it every frame
+    ShadowMaps shadows;
+    shadows.init();
 
     // unsigned int specular_map = loadTexture("../resources/container2_specular.png");
-    // cubeShader.use();
-    
-    cubeShader.setInt("material.diffuse", 1);
-    cubeShader.setInt("material.specular", 1);
+    // diffuse and specular both read the texture array on unit 0
+    for (const Shader * shader : { &cubeShader, &cubeProcShader, &cubeMatteShader, &cubeMatteProcShader, &impostorShader,
+                                   &cubeDeferredShader, &cubeProcDeferredShader, &cubeMatteDeferredShader, &cubeMatteProcDeferredShader,
+                                   &impostorDeferredShader, &impostorDepthShader, &cubeInstShader, &cubeMatteInstShader,
+                                   &cubeInstDeferredShader, &cubeMatteInstDeferredShader })
+    {
+        shader->use();
+        shader->setInt("material.diffuse", 0);
+        shader->setInt("material.specular", 0);
+    }
 
     float radius = 5.0f;
     float height = 3.0f;
@@ -333,6 +623,11 @@ int main(int, char**)
         0.0f
     }, 1, sphereVAO, cubeShader);
 
+    // textured nodes point at their tile in the streamer's texture array
+    head.setTexture(face_map);
+    Earth.setTexture(earth_map);
+    frame.textures = &textures;
+
     body.addChild(&head);
     body.addChild(&leftShoulder);
     body.addChild(&rightShoulder);
@@ -349,20 +644,48 @@ int main(int, char**)
     hip.addChild(&body);
 
     body.m_color = glm::vec3(0.0f, 1.0f, 0.0f);
+    // a robot hidden behind the Earth is dropped in one box test, a hidden upper body
+    // while the legs show in a second
+    hip.m_queryRoot = true;
+    body.m_queryRoot = true;
     leftShoulder.m_color = glm::vec3(0.0f, 1.0f, 0.0f);
 
     // Main loop
-    while (!glfwWindowShouldClose(window))
+    int frameIndex = 0;
+    // --bench stops after its measured frames, --headless after --frames, windowed
+    // runs go on until closed
+    while (bench ? !benchmark.done() : headless ? frameIndex < frames : !glfwWindowShouldClose(window))
     {
+        if (bench)
+            benchmark.beginFrame(shaderCompiler().pending() > 0 || textures.m_pending > 0 || earthPages.m_pending > 0);
         // ---------------------
         // GLFW & imGUI settings
         // ---------------------
 
-        glfwPollEvents();
+        if (!headless)
+            glfwPollEvents();
+        // swap in programs that finished compiling since the last frame
+        shaderCompiler().poll();
+        for (const std::string & path : watcher.poll())
+        {
+            editedAssets().insert(assetName(path));
+            assetArchive().markEdited(path);
+            unsigned int reloaded = shaders.reload(assetName(path)) + textures.reload(path);
+            if (reloaded)
+                std::cout << "reloading " << path << " (" << reloaded << " users)" << std::endl;
+        }
+        // finish decoded textures a slice at a time
+        textures.update();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
+        if (headless)
+        {
+            io.DisplaySize = ImVec2((float)frameWidth, (float)frameHeight);
+            io.DeltaTime = deltaTime > 0.0f ? deltaTime : 1.0f / 60.0f;
+        }
+        else
+            ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
 
@@ -374,6 +697,7 @@ int main(int, char**)
         ImGui::SliderFloat("height", &height, -4.0f, 4.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
         ImGui::SliderFloat("light angle", &lightAngle, 0.0f, 360.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
         ImGui::ColorEdit3("light color", (float*)&Im_light_color);        // Edit 3 floats representing a color
+        ImGui::SliderInt("dynamic lights", &lightCount, 0, 1024);
         ImGui::End();
 
         ImGui::Begin("Color Settings");
@@ -388,20 +712,75 @@ int main(int, char**)
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
         ImGui::End();
 
+        ImGui::Begin("Render Stats");
+
+        ImGui::Checkbox("sphere LOD", &frame.useSphereLOD);
+        ImGui::Checkbox("sphere impostors", &useImpostors);
+        ImGui::Checkbox("procedural primitives", &useProcedural);
+        ImGui::Checkbox("instanced crowd (procedural)", &useInstancedCrowd);
+        ImGui::SliderInt("crowd size", &crowdSize, 0, 10000);
+        ImGui::Checkbox("virtual texture", &useVirtualTexture);
+        ImGui::Checkbox("specular", &useSpecular);
+        ImGui::Checkbox("deferred shading", &useDeferred);
+        ImGui::Checkbox("shadows", &shadows.m_enabled);
+        ImGui::Checkbox("depth pre-pass", &useDepthPrepass);
+        ImGui::Checkbox("front-to-back", &sortFrontToBack);
+        ImGui::Checkbox("occlusion culling", &useOcclusionCulling);
+        ImGui::Checkbox("GPU occlusion queries", &useOcclusionQueries);
+        ImGui::Checkbox("conditional render", &queries.m_conditional);
+        ImGui::Checkbox("capture frames", &recordFrames);
+        ImGui::Text("impostors: %u", frame.impostorCount);
+        ImGui::Text("shader variants: %u", shaders.size());
+        ImGui::Text("scene GPU: %.2f ms %s, G-buffer %zu KB", sceneTimer.ms(), useDeferred ? "deferred" : "forward", deferred.bytes() / 1024);
+        ImGui::Text("shader startup: %u cached %.1f ms, %u compiled %.1f ms, %u compiling", programCache().m_loaded, programCache().m_loadMs,
+                    programCache().m_compiled, programCache().m_compileMs, shaderCompiler().pending());
+        ImGui::Text("clustered lights: %u lights, %u references, %u max per cluster, binned in %.2f ms on %u threads", clusters.m_lights,
+                    clusters.m_references, clusters.m_maxPerCluster, clusters.m_binMs, clusters.m_threads);
+        float pixels = std::max(1.0f, io.DisplaySize.x * io.DisplayFramebufferScale.x * io.DisplaySize.y * io.DisplayFramebufferScale.y);
+        if (useOcclusionQueries)
+            ImGui::Text("fragments shaded: not counted while the occlusion queries run, pre-pass %.2fM",
+                        useDepthPrepass ? prepassSamples.m_result / 1.0e6 : 0.0);
+        else
+            ImGui::Text("fragments shaded: %.2fM (%.2f per pixel), pre-pass %.2fM", shadedSamples.m_result / 1.0e6,
+                        shadedSamples.m_result / pixels, useDepthPrepass ? prepassSamples.m_result / 1.0e6 : 0.0);
+        ImGui::Text("occlusion culling: %u occluded + %u outside of %u, %u occluder triangles, raster %.2f ms + test %.2f ms on %u threads",
+                    occlusion.m_culled, occlusion.m_outside, occlusion.m_tested, occlusion.m_triangles, occlusion.m_rasterMs,
+                    occlusion.m_testMs, occlusion.m_threads);
+        ImGui::Text("occlusion queries: %u issued, %u subtrees hidden, %u skipped on the CPU, %u results pending",
+                    queries.m_issued, queries.m_hidden, queries.m_skipped, queries.m_pending);
+        ImGui::Text("capture: %u frames, %u written, %u dropped, read back %.2f ms", capture.m_captured, capture.m_written,
+                    capture.m_dropped, capture.m_readMs);
+        ImGui::Text("shadows: %.2f ms GPU, %.2f ms CPU, static cache %.0f%% hits (%u redraws), %u dynamic casters, %zu KB",
+                    shadows.gpuMs(), shadows.m_cpuMs, 100.0f * shadows.hitRate(), shadows.m_staticRenders, shadows.m_dynamicDraws,
+                    shadows.bytes() / 1024);
+        ImGui::Text("virtual pages: %u/%u resident, %u requested, %u loaded, %u evicted", earthPages.m_resident, earthPages.slotCount(),
+                    earthPages.m_requested, earthPages.m_loaded, earthPages.m_evicted);
+        ImGui::Text("textures: %u streaming, %u KB uploaded", textures.m_pending, textures.m_bytesUploaded / 1024);
+        for (const TextureStats & texture : textures.stats())
+            ImGui::Text("  %s %dx%d layer %d %s: %zu KB (%zu KB raw)", texture.path.substr(texture.path.find_last_of('/') + 1).c_str(),
+                        texture.width, texture.height, texture.layer, blockFormatName(texture.internalFormat), texture.bytes / 1024, texture.rawBytes / 1024);
+        for (unsigned int i = 0; i < sphereLODs.size(); ++i)
+            ImGui::Text("LOD %u (%ux%u): %u draws, %u triangles", i, sphereLODs[i].segments, sphereLODs[i].segments, frame.lodStats.draws[i], frame.lodStats.triangles[i]);
+        ImGui::End();
+
         // Rendering
         ImGui::Render();
-        int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
+        int display_w = frameWidth, display_h = frameHeight;
+        if (!headless)
+            glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
         glEnable(GL_DEPTH_TEST);
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 
         // process time
         // ------------
-        currentTime = glfwGetTime();
+        currentTime = seconds();
         deltaTime = currentTime - lastTime;
         lastTime = currentTime;
-        processInput(window, camera, deltaTime);
+        if (bench)
+            camera.LookAt(benchCameraPosition(currentTime), glm::vec3(0.0f));
+        else if (!headless)
+            processInput(window, camera, deltaTime);
 
         // ---------------------
         // configure all shaders
@@ -410,68 +789,220 @@ int main(int, char**)
         // initlize matrices: projectin & view & model
         // -------------------------------------------
         glm::mat4 projection = 
-            glm::perspective(glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f,100.0f);
+            glm::perspective(glm::radians(45.0f), (float)display_w / display_h, 0.1f,100.0f);
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
+        frame.begin(view, projection, display_h);
+        frame.impostors = useImpostors ? &impostors : nullptr;
+        frame.procedural = useProcedural ? &procedural : nullptr;
+
+        // virtual texture feedback
+        // ------------------------
+        // impostors keep the array tile, only mesh and procedural Earths page
+        // the specular switch picks a variant, there is no runtime branch in the shaders
+        // nodes keep their own copy of the shader, only swapped when a switch flips
+        int shaderChoice = (useSpecular ? 1 : 0) | (useVirtualTexture ? 2 : 0);
+        if (shaderChoice != nodeShaderChoice)
+        {
+            const Shader & litShader = useSpecular ? cubeShader : cubeMatteShader;
+            head.m_shader = litShader;
+            Earth.m_shader = useVirtualTexture ? (useSpecular ? earthShader : earthMatteShader) : litShader;
+            nodeShaderChoice = shaderChoice;
+        }
+        if (useVirtualTexture && !useImpostors)
+        {
+            for (const Shader * shader : { &feedbackShader, &feedbackProcShader })
+            {
+                earthPages.bindFeedback(*shader);
+                shader->setMat4("projection", projection);
+                shader->setMat4("view", view);
+            }
+            frame.shaderOverride = &feedbackShader;
+            earthPages.beginFeedback(display_w, display_h);
+            frame.queryInstance = 0;
+            Earth.draw(glm::mat4(1.0f), frame);
+            earthPages.endFeedback(display_w, display_h);
+            frame.shaderOverride = nullptr;
+            frame.lodStats.reset();
+        }
+        earthPages.update();
 
         // configure cubeShader
         // --------------------
-        cubeShader.use();
-        // configure material
-        cubeShader.setFloat("material.shininess", specular_constant);
-        // configure light
         lightPos = glm::vec3(radius * sin(glm::radians(lightAngle)), height, radius * cos(glm::radians(lightAngle)));
         light_color = glm::vec3(Im_light_color.x * Im_light_color.w, Im_light_color.y * Im_light_color.w, Im_light_color.z * Im_light_color.w);
 
-        cubeShader.setVec3("light.ambient",  0.3f * light_color);
-        cubeShader.setVec3("light.diffuse",  0.5f * light_color);
-        cubeShader.setVec3("light.specular",  1.0f * light_color);
-        cubeShader.setVec3("light.direction", lightPos);
-        // cubeShader.setVec3("light.position", lightPos);
-        cubeShader.setVec3("viewPos", camera.Position);
-        // set projection & view
-        cubeShader.setMat4("projection", projection);
-        cubeShader.setMat4("view", view);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, earth_map);
+        for (const Shader * shader : { &cubeShader, &cubeProcShader, &cubeMatteShader, &cubeMatteProcShader,
+                                       &earthShader, &earthProcShader, &earthMatteShader, &earthMatteProcShader,
+                                       &cubeDeferredShader, &cubeProcDeferredShader, &cubeMatteDeferredShader, &cubeMatteProcDeferredShader,
+                                       &earthDeferredShader, &earthProcDeferredShader, &earthMatteDeferredShader, &earthMatteProcDeferredShader,
+                                       &cubeInstShader, &cubeMatteInstShader, &cubeInstDeferredShader, &cubeMatteInstDeferredShader,
+                                       &resolveShader })
+        {
+            shader->use();
+            // configure material
+            shader->setFloat("material.shininess", specular_constant);
+            // configure light
+            shader->setVec3("light.ambient",  0.3f * light_color);
+            shader->setVec3("light.diffuse",  0.5f * light_color);
+            shader->setVec3("light.specular",  1.0f * light_color);
+            shader->setVec3("light.direction", lightPos);
+            // shader->setVec3("light.position", lightPos);
+            shader->setVec3("viewPos", camera.Position);
+            // set projection & view
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+        }
 
-        Earth.draw(glm::mat4(1.0f));
+        // animation
+        float angle = (float)seconds();
+        rightShoulder.m_trans.m_degrees = glm::radians(-80.0f + 30.0f * sin(angle * 2));
+        rightElbow.m_trans.m_degrees = glm::radians(-50.0f + 30.0f * sin(angle * 2));
+        rightThigh.m_trans.m_degrees = glm::radians(30.0f * sin(angle * 2));
+        leftThigh.m_trans.m_degrees = -glm::radians(30.0f * sin(angle * 2));
+        leftShoulder.m_trans.m_degrees = glm::radians(45.0f * sin(angle * 2));
+        body.m_trans.m_degrees = glm::radians(20.0f * sin(angle * 2));
+        glm::mat4 overallModel = glm::rotate(glm::mat4(1.0f), -(float)seconds(), glm::vec3(0.0f, 1.0f, 0.0f));
+        overallModel = glm::translate(overallModel, glm::vec3(5.0f, 0.0f, 0.0f));
 
-        glBindTexture(GL_TEXTURE_2D, face_map);
+        // every robot strikes the same pose, one sphere around the hip bounds them all
+        float robotRadius = hip.reach(glm::mat4(1.0f), glm::vec3(0.0f));
+
+        // crowd: copies of the model on a grid behind the animated one
+        int crowdSide = (int)ceil(sqrt((float)crowdSize));
+        auto crowdOffset = [&](int i) {
+            return glm::vec3(6.0f * (i % crowdSide - crowdSide / 2), 0.0f, -10.0f - 8.0f * (i / crowdSide));
+        };
+        // robots gathered in crowdModels / crowdIds drawn in one go
+        bool instancedCrowd = useProcedural && useInstancedCrowd;
+        auto drawCrowd = [&]() {
+            if (crowdModels.empty())
+                return;
+            procedural.setInstances(crowdModels);
+            frame.instances = &crowdModels;
+            frame.instanceIds = &crowdIds;
+            hip.drawInstanced(glm::mat4(1.0f), frame);
+            frame.instances = nullptr;
+            frame.instanceIds = nullptr;
+            crowdModels.clear();
+            crowdIds.clear();
+        };
+
+        // shadows
+        // -------
+        // every caster as a mesh or procedural node, impostors have no depth pass
+        SphereImpostors * sceneImpostors = frame.impostors;
+        frame.impostors = nullptr;
+        frame.shaderOverride = &shadowShader;
+        shadows.render(lightPos, [&](int face, const glm::mat4 & lightView, const glm::mat4 & lightProjection, bool dynamic) {
+            for (const Shader * shader : { &shadowShader, &shadowProcShader, &shadowInstShader })
+            {
+                shadows.bindCaster(*shader);
+                shader->setMat4("projection", lightProjection);
+                shader->setMat4("view", lightView);
+            }
+            if (!dynamic)
+            {
+                frame.queryInstance = 0;
+                Earth.draw(glm::mat4(1.0f), frame);
+                return;
+            }
+            if (shadows.faceSees(face, glm::vec3(overallModel[3]), robotRadius))
+            {
+                frame.queryInstance = 1;
+                hip.draw(overallModel, frame);
+                shadows.m_dynamicDraws++;
+            }
+            for (int i = 0; i < crowdSize; ++i)
+                if (shadows.faceSees(face, crowdOffset(i), robotRadius))
+                {
+                    if (instancedCrowd)
+                    {
+                        crowdModels.push_back(glm::translate(glm::mat4(1.0f), crowdOffset(i)));
+                        crowdIds.push_back(i + 2);
+                    }
+                    else
+                    {
+                        frame.queryInstance = i + 2;
+                        hip.draw(glm::translate(glm::mat4(1.0f), crowdOffset(i)), frame);
+                    }
+                    shadows.m_dynamicDraws++;
+                }
+            drawCrowd();
+        });
+        frame.shaderOverride = nullptr;
+        frame.impostors = sceneImpostors;
+        frame.lodStats.reset();
+        glViewport(0, 0, display_w, display_h);
+
+        // clustered lights
+        // ----------------
+        // the scattered lights circle the scene slowly
+        if (lightCount != (int)sceneLights.size())
+            scatterLights(sceneLights, lightCount);
+        float lightTurn = 0.2f * deltaTime;
+        for (SceneLight & light : sceneLights)
+            light.position = glm::vec3(cos(lightTurn) * light.position.x + sin(lightTurn) * light.position.z, light.position.y,
+                                       cos(lightTurn) * light.position.z - sin(lightTurn) * light.position.x);
+        clusters.update(sceneLights, view, projection, 0.1f, 100.0f, display_w, display_h);
+        for (const Shader * shader : { &cubeShader, &cubeProcShader, &cubeMatteShader, &cubeMatteProcShader, &earthShader, &earthProcShader,
+                                       &earthMatteShader, &earthMatteProcShader, &colorShader, &colorProcShader, &impostorShader,
+                                       &cubeInstShader, &cubeMatteInstShader, &colorInstShader, &resolveShader })
+        {
+            clusters.bind(*shader);
+            shadows.bind(*shader);
+        }
+
+        // configure impostorShader
+        // ------------------------
+        for (const Shader * shader : { &impostorShader, &impostorDeferredShader, &impostorDepthShader })
+        {
+            shader->use();
+            shader->setFloat("material.shininess", specular_constant);
+            shader->setVec3("light.ambient",  0.3f * light_color);
+            shader->setVec3("light.diffuse",  0.5f * light_color);
+            shader->setVec3("light.specular",  1.0f * light_color);
+            shader->setVec3("light.direction", lightPos);
+            shader->setVec3("lightPos", lightPos);
+            shader->setVec3("lightColor", light_color);
+            shader->setVec3("viewPos", camera.Position);
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+        }
+
+        // every diffuse map lives in this one array, nodes pick their layer and rect
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures.texture());
+        for (const Shader * shader : { &earthShader, &earthProcShader, &earthMatteShader, &earthMatteProcShader,
+                                       &earthDeferredShader, &earthProcDeferredShader, &earthMatteDeferredShader, &earthMatteProcDeferredShader })
+            earthPages.bind(*shader);
 
         // configure colorShader
         // ---------------------
-        colorShader.use();
-        colorShader.setMat4("projection", projection);
-        colorShader.setMat4("view", view);
-        colorShader.setMat4("model", model);
-        colorShader.setVec3("lightPos", lightPos);
-        colorShader.setVec3("lightColor", light_color);
+        for (const Shader * shader : { &colorShader, &colorProcShader, &colorDeferredShader, &colorProcDeferredShader,
+                                       &colorInstShader, &colorInstDeferredShader })
+        {
+            shader->use();
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+            shader->setMat4("model", model);
+            shader->setVec3("lightPos", lightPos);
+            shader->setVec3("lightColor", light_color);
+        }
         // colorShader.setVec3("objectColor", glm::vec3(0.5f, 0.5f, 0.5f));
 
         // configure lightShader
         // ---------------------
-        lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
         model = glm::translate(model, lightPos);
         model = glm::scale(model, glm::vec3(0.2f));
-        lightShader.setMat4("model", model);
-        lightShader.setVec3("inputColor", light_color);
-        
-        lightCube.draw(model);
-
-        // animation
-        float angle = (float)glfwGetTime();
-        rightShoulder.m_trans.m_degrees = glm::radians(-80.0f + 30.0f * sin(angle * 2));
-        rightElbow.m_trans.m_degrees = glm::radians(-50.0f + 30.0f * sin(angle * 2));
-        rightThigh.m_trans.m_degrees = glm::radians(30.0f * sin(angle * 2));
-        leftThigh.m_trans.m_degrees = -glm::radians(30.0f * sin(angle * 2));
-        leftShoulder.m_trans.m_degrees = glm::radians(45.0f * sin(angle * 2));
-        body.m_trans.m_degrees = glm::radians(20.0f * sin(angle * 2));
-        glm::mat4 overallModel = glm::rotate(glm::mat4(1.0f), -(float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f));
+        for (const Shader * shader : { &lightShader, &lightProcShader })
+        {
+            shader->use();
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+            shader->setMat4("model", model);
+            shader->setVec3("inputColor", light_color);
+        }
 
         // color
         ImConvert(body);
@@ -479,22 +1010,184 @@ int main(int, char**)
         ImConvert(rightShoulder);
         ImConvert(leftArm);
         ImConvert(rightArm);
-        
-        overallModel = glm::translate(overallModel, glm::vec3(5.0f, 0.0f, 0.0f));
-        hip.draw(overallModel);
+
+        // opaque scene: the Earth, the animated robot and the crowd, nearest first
+        // when sorted so early depth testing rejects what they hide
+        // --------------------------------------------------------------------------
+        opaqueDraws.clear();
+        opaqueDraws.push_back({ &Earth, glm::mat4(1.0f), 0.5f * Earth.m_trans.m_scale.x, 0.0f, 0 });
+        opaqueDraws.push_back({ &hip, overallModel, robotRadius, 0.0f, 1 });
+        for (int i = 0; i < crowdSize; ++i)
+            opaqueDraws.push_back({ &hip, glm::translate(glm::mat4(1.0f), crowdOffset(i)), robotRadius, 0.0f, (unsigned int)i + 2 });
+        if (useOcclusionCulling)
+        {
+            glm::mat4 hipWorld = hip.m_trans.getTrans(overallModel);
+            occlusion.begin(view, projection, 0.1f);
+            occlusion.addOccluder(sphereOccluder, glm::scale(Earth.m_trans.getTrans(glm::mat4(1.0f)), Earth.m_trans.m_scale));
+            occlusion.addOccluder(boxOccluder, glm::scale(body.m_trans.getTrans(hipWorld), body.m_trans.m_scale));
+            occlusion.render();
+            occludeeSpheres.clear();
+            for (const OpaqueDraw & draw : opaqueDraws)
+                occludeeSpheres.push_back(glm::vec4(glm::vec3(draw.model[3]), draw.radius));
+            occlusion.test(occludeeSpheres, occludeeVisible);
+            unsigned int kept = 0;
+            for (unsigned int i = 0; i < opaqueDraws.size(); ++i)
+                if (occludeeVisible[i])
+                    opaqueDraws[kept++] = opaqueDraws[i];
+            opaqueDraws.resize(kept);
+        }
+        if (sortFrontToBack)
+        {
+            for (OpaqueDraw & draw : opaqueDraws)
+                draw.depth = -(view * draw.model[3]).z;
+            std::sort(opaqueDraws.begin(), opaqueDraws.end(),
+                      [](const OpaqueDraw & a, const OpaqueDraw & b) { return a.depth < b.depth; });
+        }
+        // the crowd (ids from 2 on) is gathered in draw order, so its instances stay
+        // sorted too and their sphere levels come in long runs
+        auto drawOpaque = [&]() {
+            for (const OpaqueDraw & draw : opaqueDraws)
+            {
+                if (instancedCrowd && draw.id >= 2)
+                {
+                    crowdModels.push_back(draw.model);
+                    crowdIds.push_back(draw.id);
+                    continue;
+                }
+                frame.queryInstance = draw.id;
+                draw.node->draw(draw.model, frame);
+            }
+            drawCrowd();
+        };
+
+        // deferred: the lit nodes fill the G-buffer until the resolve below
+        sceneTimer.begin();
+        if (useDeferred)
+        {
+            deferred.begin(display_w, display_h);
+            frame.deferred = &deferred;
+        }
+
+        // depth pre-pass: positions only, then every shaded fragment is a visible one;
+        // the shaded pass redraws the levels picked here so GL_EQUAL holds
+        if (useDepthPrepass)
+        {
+            for (const Shader * shader : { &depthShader, &depthProcShader, &depthInstShader })
+            {
+                shader->use();
+                shader->setMat4("projection", projection);
+                shader->setMat4("view", view);
+            }
+            frame.shaderOverride = &depthShader;
+            frame.positionVAOs = positionVAOs;
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            prepassSamples.begin();
+            drawOpaque();
+            impostors.flush(impostorDepthShader);
+            prepassSamples.end();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            frame.shaderOverride = nullptr;
+            frame.positionVAOs = nullptr;
+            frame.lodStats.reset();
+            frame.reuseLOD = true;
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        // with impostors on, the Earth and the robots' spheres go out in the single flush below
+        if (useOcclusionQueries)
+        {
+            queries.begin(view, projection);
+            frame.queries = &queries;
+        }
+        else
+            shadedSamples.begin();
+        drawOpaque();
+        frame.queries = nullptr;
+        frame.reuseLOD = false;
+        // the ray traced depth is recomputed per program, so only LEQUAL is safe for it
+        if (useDepthPrepass)
+            glDepthFunc(GL_LEQUAL);
+        frame.impostorCount += impostors.flush(useDeferred ? impostorDeferredShader : impostorShader);
+        if (!useOcclusionQueries)
+            shadedSamples.end();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+
+        // light the G-buffer into the window, depth included
+        // ---------------------------------------------------
+        if (useDeferred)
+        {
+            frame.deferred = nullptr;
+            deferred.end();
+            resolveShader.use();
+            resolveShader.setVec3("lightPos", lightPos);
+            resolveShader.setVec3("lightColor", light_color);
+            deferred.resolve(resolveShader, view, projection);
+        }
+
+        // unlit, so forward in both paths
+        lightCube.draw(model, frame);
+        sceneTimer.end();
+
+        if (recordFrames != capture.active())
+        {
+            if (recordFrames)
+                capture.start(captureTarget, display_w, display_h);
+            else
+                capture.stop();
+        }
+        capture.capture(display_w, display_h);
+        recordFrames = capture.active();
 
         // draw UI
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        glfwSwapBuffers(window);
+        if (bench)
+            benchmark.endFrame();
+        ++frameIndex;
+        if (headless)
+        {
+            if ((bench ? benchmark.done() : frameIndex == frames) && outputPath)
+            {
+                std::vector<unsigned char> pixels((size_t)frameWidth * frameHeight * 3);
+                target.read(&pixels[0]);
+                if (!savePPM(outputPath, frameWidth, frameHeight, &pixels[0]))
+                    std::cout << "ERROR::HEADLESS::OUTPUT_FAILURE " << outputPath << std::endl;
+            }
+        }
+        else
+            glfwSwapBuffers(window);
+    }
+
+    if (bench)
+    {
+        std::string report = benchmark.report(frameWidth, frameHeight);
+        FILE * file = reportPath ? fopen(reportPath, "w") : NULL;
+        if (reportPath && !file)
+            std::cout << "ERROR::BENCH::REPORT_FAILURE " << reportPath << std::endl;
+        fputs(report.c_str(), file ? file : stdout);
+        if (file)
+            fclose(file);
     }
 
     // Cleanup
+    capture.stop();
+    queries.destroy();
     ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
+    if (!headless)
+        ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (headless)
+    {
+        target.destroy();
+        context.destroy();
+    }
+    else
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 
     return 0;
 }
@@ -0,0 +1,61 @@
+// Build step for AssetArchive.hpp: packs the input files into one archive,
+// named by their path below <root>.
+//   pack_assets [--lz4] <output.pak> <root> <file>...
+// The Makefile runs it from build/ into build/assets.pak; with --lz4 entries that
+// shrink by at least an eighth are stored compressed.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AssetArchive.hpp"
+
+int main (int argc, char ** argv)
+{
+    int first = 1;
+    bool lz4 = argc > 1 && std::string(argv[1]) == "--lz4";
+    if (lz4)
+        first++;
+    if (argc - first < 2)
+    {
+        std::cout << "usage: pack_assets [--lz4] <output.pak> <root> <file>..." << std::endl;
+        return 1;
+    }
+    std::string output = argv[first], root = argv[first + 1];
+    if (!root.empty() && root.back() != '/')
+        root += '/';
+
+    std::vector<AssetSource> sources;
+    size_t total = 0;
+    for (int i = first + 2; i < argc; ++i)
+    {
+        std::string path = argv[i];
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file || path.compare(0, root.size(), root) != 0)
+        {
+            std::cout << "ERROR::PACK_ASSETS::CANNOT_PACK " << path << std::endl;
+            return 1;
+        }
+        std::stringstream data;
+        data << file.rdbuf();
+        std::string bytes = data.str();
+
+        AssetSource source;
+        source.name = path.substr(root.size());
+        source.bytes.assign(bytes.begin(), bytes.end());
+        total += bytes.size();
+        sources.push_back(source);
+    }
+
+    if (!writeAssetArchive(output, sources, lz4))
+    {
+        std::cout << "ERROR::PACK_ASSETS::CANNOT_WRITE " << output << std::endl;
+        return 1;
+    }
+    MappedFile packed(output.c_str());
+    std::cout << output << ": " << sources.size() << " entries, " << total / 1024 << " KB in, "
+              << packed.size() / 1024 << " KB packed" << std::endl;
+    return 0;
+}
@@ -6,51 +6,64 @@
 #include <math.h>
 #include <glm/glm.hpp>
 
+#include "LOD.hpp"
+#include "TextureCache.hpp"
+
 // utility function for loading a 2D texture from file
+// mip levels come pre-baked from the texture cache (see TextureCache.hpp)
 // ---------------------------------------------------
 unsigned int loadTexture(char const * path)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
     
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    TextureImage image;
+    if (loadTextureImage(path, image))
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        uploadTextureImage(image);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     }
     else
     {
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
 }
 
+// position-only copy of an interleaved vertex buffer for depth-only passes:
+// tightly packed xyz at attribute 0, sharing the mesh's element buffer (0 for none)
+void buildPositionStream (unsigned int positionVAO, const float * vertices, unsigned int count, unsigned int stride, unsigned int ebo)
+{
+    std::vector<float> positions;
+    positions.reserve(count * 3);
+    for (unsigned int i = 0; i < count; ++i)
+        positions.insert(positions.end(), vertices + i * stride, vertices + i * stride + 3);
+
+    unsigned int vbo;
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(positionVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), &positions[0], GL_STATIC_DRAW);
+    if (ebo)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+}
+
 // before pass int sphereVAO into this function,
 // remember to call glGenVertexArrays(1, &sphereVAO) !!
-void buildSphereData(unsigned int sphereVAO, std::vector<unsigned int> & indices, std::vector<float> & data)
+// every tessellation in SPHERE_LOD_SEGMENTS is appended to the same vbo/ebo,
+// lods receives where each level's triangle strip starts in the element buffer;
+// a non-zero positionVAO also gets the positions alone (buildPositionStream)
+void buildSphereData(unsigned int sphereVAO, std::vector<unsigned int> & indices, std::vector<float> & data, std::vector<SphereLOD> & lods,
+                     unsigned int positionVAO = 0)
 {
-    unsigned int indexCount;
-
     unsigned int vbo, ebo;
     glGenBuffers(1, &vbo);
     glGenBuffers(1, &ebo);
@@ -60,49 +73,59 @@ void buildSphereData(unsigned int sphereVAO, std::vector<unsigned int> & indices
     std::vector<glm::vec3> normals;
     // std::vector<unsigned int> indices;
 
-    const unsigned int X_SEGMENTS = 64;
-    const unsigned int Y_SEGMENTS = 64;
     const float PI = 3.14159265359;
-    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+    for (unsigned int level = 0; level < SPHERE_LOD_COUNT; ++level)
     {
-        for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-        {
-            float xSegment = (float)x / (float)X_SEGMENTS;
-            float ySegment = (float)y / (float)Y_SEGMENTS;
-            float xPos = 0.5f * std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-            float yPos = 0.5f * std::cos(ySegment * PI);
-            float zPos = 0.5f * std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-            positions.push_back(glm::vec3(xPos, yPos, zPos));
-            uv.push_back(glm::vec2(xSegment, ySegment));
-            normals.push_back(glm::vec3(xPos, yPos, zPos));
-        }
-    }
-
-    bool oddRow = false;
-    for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
-    {
-        if (!oddRow) // even rows: y == 0, y == 2; and so on
+        const unsigned int X_SEGMENTS = SPHERE_LOD_SEGMENTS[level];
+        const unsigned int Y_SEGMENTS = SPHERE_LOD_SEGMENTS[level];
+        // indices are absolute, so each level is offset by the vertices already generated
+        const unsigned int baseVertex = positions.size();
+        SphereLOD lod;
+        lod.segments = X_SEGMENTS;
+        lod.firstIndex = indices.size();
+
+        for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
         {
             for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
             {
-                indices.push_back(y       * (X_SEGMENTS + 1) + x);
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                float xSegment = (float)x / (float)X_SEGMENTS;
+                float ySegment = (float)y / (float)Y_SEGMENTS;
+                float xPos = 0.5f * std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+                float yPos = 0.5f * std::cos(ySegment * PI);
+                float zPos = 0.5f * std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+
+                positions.push_back(glm::vec3(xPos, yPos, zPos));
+                uv.push_back(glm::vec2(xSegment, ySegment));
+                normals.push_back(glm::vec3(xPos, yPos, zPos));
             }
         }
 
-        // 这里奇偶分开添加是有道理的，奇偶分开添加，就能首位相连，自己可以拿笔画一画
-        else
+        bool oddRow = false;
+        for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
         {
-            for (int x = X_SEGMENTS; x >= 0; --x)
+            if (!oddRow) // even rows: y == 0, y == 2; and so on
+            {
+                for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+                {
+                    indices.push_back(baseVertex + y       * (X_SEGMENTS + 1) + x);
+                    indices.push_back(baseVertex + (y + 1) * (X_SEGMENTS + 1) + x);
+                }
+            }
+
+            // 这里奇偶分开添加是有道理的，奇偶分开添加，就能首位相连，自己可以拿笔画一画
+            else
             {
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                indices.push_back(y       * (X_SEGMENTS + 1) + x);
+                for (int x = X_SEGMENTS; x >= 0; --x)
+                {
+                    indices.push_back(baseVertex + (y + 1) * (X_SEGMENTS + 1) + x);
+                    indices.push_back(baseVertex + y       * (X_SEGMENTS + 1) + x);
+                }
             }
+            oddRow = !oddRow;
         }
-        oddRow = !oddRow;
+        lod.indexCount = indices.size() - lod.firstIndex;
+        lods.push_back(lod);
     }
-    indexCount = indices.size();
 
     // std::vector<float> data;
     for (unsigned int i = 0; i < positions.size(); ++i)
@@ -134,11 +157,14 @@ void buildSphereData(unsigned int sphereVAO, std::vector<unsigned int> & indices
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    if (positionVAO)
+        buildPositionStream(positionVAO, &data[0], positions.size(), 8, ebo);
 }
 
 // before pass int cubeVAO into this function,
 // remember to call glGenVertexArrays(1, &cubeVAO) !!
-void buildCubeData (unsigned cubeVAO)
+// a non-zero positionVAO also gets the positions alone (buildPositionStream)
+void buildCubeData (unsigned cubeVAO, unsigned positionVAO = 0)
 {
     float vertices[] = {
         // positions          // normals           // texture coords
@@ -200,4 +226,6 @@ void buildCubeData (unsigned cubeVAO)
     // textures
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
+    if (positionVAO)
+        buildPositionStream(positionVAO, vertices, 36, 8, 0);
 }
\ No newline at end of file